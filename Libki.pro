@@ -3,32 +3,28 @@ TARGET = libkiclient
 DEPENDPATH += .
 INCLUDEPATH += .
 
-QT += core
-QT += gui
-QT += network
-QT += script
-QT += webkitwidgets
+include(libki.pri)
+
+# Developer tools that are not part of a kiosk install: the fleet load
+# generator and a mock server ("libkiclient --help"). Build with
+# "qmake CONFIG+=devtools".
+devtools {
+    HEADERS += devtools.h \
+        fleetsimulator.h
+    SOURCES += devtools.cpp \
+        fleetsimulator.cpp
+}
+
+# "make check" builds the QtTest suite in tests/ and runs it offscreen
+check.commands = $(MKDIR) tests && cd tests && \
+    $$QMAKE_QMAKE $$shell_quote($$PWD/tests/tests.pro) && $(MAKE) check
+QMAKE_EXTRA_TARGETS += check
 
 #CONFIG += console
 
 # Input
-HEADERS += loginwindow.h networkclient.h timerwindow.h \
-    sessionlockedwindow.h \
-    logutils.h \
-    timesplash.h \
-    utils.h
-FORMS += loginwindow.ui timerwindow.ui \
-    sessionlockedwindow.ui
-RESOURCES += libki.qrc
 RC_FILE += libki.rc
-SOURCES += loginwindow.cpp \
-           main.cpp \
-           networkclient.cpp \
-           timerwindow.cpp \
-           utils.cpp \
-    sessionlockedwindow.cpp \
-    logutils.cpp \
-    timesplash.cpp
+SOURCES += main.cpp
 TRANSLATIONS = languages/libkiclient_fr.ts \
         languages/libkiclient_sv.ts \
         languages/libkiclient_es.ts \
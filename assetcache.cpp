@@ -0,0 +1,250 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "assetcache.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+
+#include "utils.h"
+
+// Don't revalidate an asset more often than this, banner changes are
+// announced by the server through the register_node reply anyway
+#define ASSET_REVALIDATE_INTERVAL 300
+
+// Default upper bound for the cache directory, in megabytes
+#define ASSET_CACHE_SIZE 20
+
+AssetCache *AssetCache::instance() {
+  static AssetCache *assetCache = new AssetCache();
+  return assetCache;
+}
+
+AssetCache::AssetCache(QObject *parent) : QObject(parent) {
+  qDebug("ENTER AssetCache::AssetCache");
+
+  QSettings settings;
+  settings.setIniCodec("UTF-8");
+
+  int cacheSize = ASSET_CACHE_SIZE;
+  if (!settings.value("cache/asset_cache_size").toString().isEmpty()) {
+    cacheSize = settings.value("cache/asset_cache_size").toInt();
+  }
+  maxCacheSize = qint64(cacheSize) * 1024 * 1024;
+
+  cacheDirectory = getCacheDirectory() + "/assets";
+  QDir().mkpath(cacheDirectory);
+  qDebug() << "ASSET CACHE DIR: " << cacheDirectory;
+
+  index = new QSettings(cacheDirectory + "/index.ini", QSettings::IniFormat,
+                        this);
+  index->setIniCodec("UTF-8");
+
+  nam = new QNetworkAccessManager(this);
+  connect(nam, SIGNAL(finished(QNetworkReply *)), this,
+          SLOT(processPrefetchReply(QNetworkReply *)));
+
+  qDebug("LEAVE AssetCache::AssetCache");
+}
+
+QString AssetCache::keyForUrl(const QUrl &url) {
+  return QString(
+      QCryptographicHash::hash(url.toEncoded(), QCryptographicHash::Sha1)
+          .toHex());
+}
+
+bool AssetCache::isCacheable(const QUrl &url) {
+  return url.isValid() &&
+         (url.scheme() == "http" || url.scheme() == "https") &&
+         !url.host().isEmpty();
+}
+
+QString AssetCache::localPath(const QUrl &url) {
+  if (!isCacheable(url)) return QString();
+
+  QString key = keyForUrl(url);
+  QString file = index->value(key + "/file").toString();
+  if (file.isEmpty()) return QString();
+
+  QString path = cacheDirectory + "/" + file;
+
+  // Check the content against the stored hash once per run, a truncated or
+  // corrupted file is dropped and fetched again
+  if (!verified.contains(key)) {
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+      remove(key);
+      return QString();
+    }
+
+    QString sha1 = QString(
+        QCryptographicHash::hash(f.readAll(), QCryptographicHash::Sha1)
+            .toHex());
+    if (sha1 != index->value(key + "/sha1").toString()) {
+      qDebug() << "ASSET CACHE HASH MISMATCH: " << url.toString();
+      f.close();
+      remove(key);
+      return QString();
+    }
+    verified.insert(key);
+  }
+
+  index->setValue(key + "/used", QDateTime::currentDateTime().toTime_t());
+
+  return path;
+}
+
+QString AssetCache::contentType(const QUrl &url) {
+  return index->value(keyForUrl(url) + "/content_type").toString();
+}
+
+QByteArray AssetCache::data(const QUrl &url) {
+  QString path = localPath(url);
+  if (path.isEmpty()) return QByteArray();
+
+  QFile f(path);
+  if (!f.open(QIODevice::ReadOnly)) return QByteArray();
+
+  return f.readAll();
+}
+
+void AssetCache::prefetch(const QUrl &url) {
+  if (!isCacheable(url) || pending.contains(url)) return;
+
+  QString key = keyForUrl(url);
+  uint now = QDateTime::currentDateTime().toTime_t();
+  uint fetched = index->value(key + "/fetched").toUInt();
+  if (fetched && now - fetched < ASSET_REVALIDATE_INTERVAL &&
+      !localPath(url).isEmpty()) {
+    return;
+  }
+
+  qDebug() << "ASSET CACHE PREFETCH: " << url.toString();
+
+  QNetworkRequest request(url);
+  QString etag = index->value(key + "/etag").toString();
+  if (!etag.isEmpty() && !localPath(url).isEmpty()) {
+    request.setRawHeader("If-None-Match", etag.toUtf8());
+  }
+
+  pending.insert(url);
+  nam->get(request);
+}
+
+void AssetCache::processPrefetchReply(QNetworkReply *reply) {
+  qDebug("ENTER AssetCache::processPrefetchReply");
+
+  QUrl url = reply->request().url();
+  pending.remove(url);
+
+  int status =
+      reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+  QString key = keyForUrl(url);
+
+  if (reply->error() != QNetworkReply::NoError) {
+    qDebug() << "ASSET CACHE FETCH FAILED: " << url.toString()
+             << reply->errorString();
+  } else if (status == 304) {
+    qDebug() << "ASSET CACHE NOT MODIFIED: " << url.toString();
+    index->setValue(key + "/fetched", QDateTime::currentDateTime().toTime_t());
+  } else {
+    store(url, reply->readAll(),
+          reply->header(QNetworkRequest::ContentTypeHeader).toString(),
+          QString(reply->rawHeader("ETag")));
+  }
+
+  reply->deleteLater();
+
+  qDebug("LEAVE AssetCache::processPrefetchReply");
+}
+
+void AssetCache::store(const QUrl &url, const QByteArray &content,
+                       const QString &contentType, const QString &etag) {
+  QString key = keyForUrl(url);
+  QString sha1 = QString(
+      QCryptographicHash::hash(content, QCryptographicHash::Sha1).toHex());
+  bool changed = sha1 != index->value(key + "/sha1").toString() ||
+                 localPath(url).isEmpty();
+
+  if (changed) {
+    QSaveFile file(cacheDirectory + "/" + key);
+    if (!file.open(QIODevice::WriteOnly) || file.write(content) < 0 ||
+        !file.commit()) {
+      qDebug() << "ASSET CACHE WRITE FAILED: " << file.errorString();
+      return;
+    }
+  }
+
+  uint now = QDateTime::currentDateTime().toTime_t();
+  index->beginGroup(key);
+  index->setValue("url", url.toString());
+  index->setValue("file", key);
+  index->setValue("sha1", sha1);
+  index->setValue("etag", etag);
+  index->setValue("content_type", contentType);
+  index->setValue("size", content.size());
+  index->setValue("fetched", now);
+  index->setValue("used", now);
+  index->endGroup();
+  verified.insert(key);
+
+  evict();
+  index->sync();
+
+  if (changed) {
+    qDebug() << "ASSET CACHE UPDATED: " << url.toString() << content.size()
+             << "bytes";
+    emit assetUpdated(url);
+  }
+}
+
+void AssetCache::remove(const QString &key) {
+  QString file = index->value(key + "/file").toString();
+  if (!file.isEmpty()) QFile::remove(cacheDirectory + "/" + file);
+
+  index->remove(key);
+  verified.remove(key);
+}
+
+/* Drops the least recently used assets until the cache fits its size bound */
+void AssetCache::evict() {
+  QStringList keys = index->childGroups();
+
+  qint64 total = 0;
+  foreach (const QString &key, keys) {
+    total += index->value(key + "/size").toLongLong();
+  }
+
+  while (total > maxCacheSize && !keys.isEmpty()) {
+    QString oldest = keys.first();
+    foreach (const QString &key, keys) {
+      if (index->value(key + "/used").toUInt() <
+          index->value(oldest + "/used").toUInt()) {
+        oldest = key;
+      }
+    }
+
+    qDebug() << "ASSET CACHE EVICT: " << index->value(oldest + "/url");
+    total -= index->value(oldest + "/size").toLongLong();
+    keys.removeAll(oldest);
+    remove(oldest);
+  }
+}
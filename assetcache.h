@@ -0,0 +1,74 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ASSETCACHE_H
+#define ASSETCACHE_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QSettings>
+#include <QUrl>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+
+/* Disk backed cache for the banner and logo images shown on the login and
+ * session locked screens. Entries are revalidated in the background with the
+ * server's ETag and stored with a SHA-1 of their content, so the windows can
+ * render from the local copy even when the server is unreachable. */
+class AssetCache : public QObject {
+  Q_OBJECT
+
+ public:
+  static AssetCache *instance();
+
+  QString localPath(const QUrl &url);
+  QString contentType(const QUrl &url);
+  QByteArray data(const QUrl &url);
+  bool isCacheable(const QUrl &url);
+
+ signals:
+
+  void assetUpdated(const QUrl &url);
+
+ public slots:
+
+  void prefetch(const QUrl &url);
+
+ private slots:
+
+  void processPrefetchReply(QNetworkReply *reply);
+
+ private:
+  AssetCache(QObject *parent = 0);
+
+  QNetworkAccessManager *nam;
+  QSettings *index;
+  QString cacheDirectory;
+  qint64 maxCacheSize;
+
+  QSet<QUrl> pending;
+  QSet<QString> verified;
+
+  QString keyForUrl(const QUrl &url);
+  void store(const QUrl &url, const QByteArray &content,
+             const QString &contentType, const QString &etag);
+  void remove(const QString &key);
+  void evict();
+};
+
+#endif  // ASSETCACHE_H
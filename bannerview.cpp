@@ -0,0 +1,219 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bannerview.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QPixmap>
+#include <QStringList>
+
+#ifdef LIBKI_WITH_WEBKIT
+#include <QWebView>
+#endif  // ifdef LIBKI_WITH_WEBKIT
+
+#include "assetcache.h"
+
+BannerView::BannerView(QWidget *parent) : QWidget(parent) {
+  qDebug("ENTER BannerView::BannerView");
+
+  stack = new QStackedLayout(this);
+  stack->setContentsMargins(0, 0, 0, 0);
+
+  label = new QLabel(this);
+  label->setAlignment(Qt::AlignCenter);
+  label->setTextFormat(Qt::RichText);
+  label->setWordWrap(true);
+  label->setContextMenuPolicy(Qt::NoContextMenu);
+  stack->addWidget(label);
+
+#ifdef LIBKI_WITH_WEBKIT
+  // Only created when a banner actually needs a browser engine
+  webView = Q_NULLPTR;
+#endif  // ifdef LIBKI_WITH_WEBKIT
+
+  connect(AssetCache::instance(), SIGNAL(assetUpdated(QUrl)), this,
+          SLOT(assetUpdated(QUrl)));
+
+  qDebug("LEAVE BannerView::BannerView");
+}
+
+void BannerView::load(const QUrl &url) {
+  qDebug() << "ENTER BannerView::load " << url.toString();
+
+  currentUrl = url;
+  render();
+
+  AssetCache::instance()->prefetch(url);
+
+  qDebug("LEAVE BannerView::load");
+}
+
+QUrl BannerView::url() const { return currentUrl; }
+
+void BannerView::assetUpdated(const QUrl &url) {
+  if (url == currentUrl) {
+    qDebug() << "BannerView::assetUpdated " << url.toString();
+    render();
+  }
+}
+
+bool BannerView::isImage(const QUrl &url, const QString &contentType) {
+  if (!contentType.isEmpty()) {
+    return contentType.startsWith("image/");
+  }
+
+  static QStringList imageSuffixes = QStringList() << ".png" << ".jpg"
+                                                   << ".jpeg" << ".gif"
+                                                   << ".bmp" << ".svg";
+  QString path = url.path().toLower();
+  foreach (const QString &suffix, imageSuffixes) {
+    if (path.endsWith(suffix)) return true;
+  }
+
+  return false;
+}
+
+/* Returns the file a url without a network scheme points to, e.g.
+ * "images/logo.png", "C:/libki/logo.png" or a file:// url, or an empty string
+ * for remote urls */
+QString BannerView::localFile(const QUrl &url) {
+  if (url.isLocalFile()) return url.toLocalFile();
+  if (url.scheme() == "qrc") return ":" + url.path();
+
+  // A Windows drive letter is parsed as the scheme
+  if (url.scheme().isEmpty() || url.scheme().length() == 1) {
+    return url.toString();
+  }
+
+  return QString();
+}
+
+void BannerView::render() {
+  AssetCache *assetCache = AssetCache::instance();
+  if (!assetCache->isCacheable(currentUrl)) {
+    renderDirectly();
+    return;
+  }
+
+  QByteArray content = assetCache->data(currentUrl);
+  QString contentType = assetCache->contentType(currentUrl);
+
+  if (content.isEmpty()) {
+#ifdef LIBKI_WITH_WEBKIT
+    // Not downloaded yet, let the browser fetch pages with their resources
+    if (!isImage(currentUrl, contentType) && currentUrl.isValid()) {
+      showHtml(QByteArray(), contentType);
+      return;
+    }
+#endif  // ifdef LIBKI_WITH_WEBKIT
+
+    // Rendered again by assetUpdated() once the asset cache has a copy
+    label->clear();
+    stack->setCurrentWidget(label);
+    return;
+  }
+
+  if (isImage(currentUrl, contentType)) {
+    showImage(content);
+  } else {
+    showHtml(content, contentType);
+  }
+}
+
+/* Local files and urls the asset cache doesn't fetch are loaded as they are */
+void BannerView::renderDirectly() {
+  QString path = localFile(currentUrl);
+  if (!path.isEmpty()) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+      qDebug() << "BannerView: unable to read " << path;
+      label->clear();
+      stack->setCurrentWidget(label);
+      return;
+    }
+
+    QByteArray content = file.readAll();
+    if (isImage(currentUrl, QString())) {
+      showImage(content);
+    } else {
+      showHtml(content, "text/html");
+    }
+    return;
+  }
+
+#ifdef LIBKI_WITH_WEBKIT
+  // Other schemes are left to the browser engine
+  if (currentUrl.isValid()) {
+    showHtml(QByteArray(), QString());
+    return;
+  }
+#endif  // ifdef LIBKI_WITH_WEBKIT
+
+  qDebug() << "BannerView: unable to load " << currentUrl.toString();
+  label->clear();
+  stack->setCurrentWidget(label);
+}
+
+void BannerView::showImage(const QByteArray &content) {
+  QPixmap pixmap;
+  if (!pixmap.loadFromData(content)) {
+    qDebug() << "BannerView: unable to decode image " << currentUrl.toString();
+    label->clear();
+  } else {
+    QSize bounds = maximumSize();
+    if (pixmap.width() > bounds.width() || pixmap.height() > bounds.height()) {
+      pixmap = pixmap.scaled(bounds, Qt::KeepAspectRatio,
+                             Qt::SmoothTransformation);
+    }
+    label->setPixmap(pixmap);
+  }
+
+  stack->setCurrentWidget(label);
+}
+
+void BannerView::showHtml(const QByteArray &content,
+                          const QString &contentType) {
+#ifdef LIBKI_WITH_WEBKIT
+  if (!webView) {
+    webView = new QWebView(this);
+    webView->setContextMenuPolicy(Qt::NoContextMenu);
+    webView->setAcceptDrops(false);
+
+    QPalette palette = webView->palette();
+    palette.setBrush(QPalette::Base, Qt::transparent);
+    webView->page()->setPalette(palette);
+    webView->setAttribute(Qt::WA_OpaquePaintEvent, false);
+
+    stack->addWidget(webView);
+  }
+
+  if (content.isEmpty()) {
+    webView->load(currentUrl);
+  } else {
+    // The original url is kept as the base so relative links still resolve
+    webView->setContent(content, contentType, currentUrl);
+  }
+  stack->setCurrentWidget(webView);
+#else
+  Q_UNUSED(contentType)
+
+  // Without QtWebKit only the subset of HTML supported by QLabel is rendered
+  label->setText(QString::fromUtf8(content));
+  stack->setCurrentWidget(label);
+#endif  // ifdef LIBKI_WITH_WEBKIT
+}
@@ -0,0 +1,63 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BANNERVIEW_H
+#define BANNERVIEW_H
+
+#include <QLabel>
+#include <QStackedLayout>
+#include <QUrl>
+#include <QWidget>
+
+#ifdef LIBKI_WITH_WEBKIT
+class QWebView;
+#endif  // ifdef LIBKI_WITH_WEBKIT
+
+/* Displays a banner or logo url. Images and simple HTML are rendered natively
+ * with a QLabel, a QWebView is only created for other pages and only when the
+ * client is built with QtWebKit. Content comes from the AssetCache. */
+class BannerView : public QWidget {
+  Q_OBJECT
+
+ public:
+  BannerView(QWidget *parent = 0);
+
+  void load(const QUrl &url);
+  QUrl url() const;
+
+ private slots:
+
+  void assetUpdated(const QUrl &url);
+
+ private:
+  QStackedLayout *stack;
+  QLabel *label;
+#ifdef LIBKI_WITH_WEBKIT
+  QWebView *webView;
+#endif  // ifdef LIBKI_WITH_WEBKIT
+
+  QUrl currentUrl;
+
+  bool isImage(const QUrl &url, const QString &contentType);
+  QString localFile(const QUrl &url);
+  void render();
+  void renderDirectly();
+  void showImage(const QByteArray &content);
+  void showHtml(const QByteArray &content, const QString &contentType);
+};
+
+#endif  // BANNERVIEW_H
@@ -0,0 +1,136 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "devtools.h"
+
+#include <stdio.h>
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QSettings>
+#include <QTextStream>
+#include <QUrl>
+
+#include "fleetsimulator.h"
+#include "mockserver.h"
+
+namespace DevTools {
+
+static const char *modes[] = {"--fleet", "--mock-server"};
+
+static void quietMessageHandler(QtMsgType type,
+                                const QMessageLogContext &context,
+                                const QString &message) {
+  Q_UNUSED(context);
+
+  // Hundreds of clients tracing every call would drown the results
+  if (type == QtDebugMsg) return;
+
+  fprintf(stderr, "%s\n", message.toLocal8Bit().constData());
+}
+
+static bool hasArgument(int argc, char *argv[], const char *option) {
+  int length = qstrlen(option);
+  for (int i = 1; i < argc; i++) {
+    if (qstrncmp(argv[i], option, length) == 0 &&
+        (argv[i][length] == '\0' || argv[i][length] == '=')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool requested(int argc, char *argv[]) {
+  for (size_t j = 0; j < sizeof(modes) / sizeof(modes[0]); j++) {
+    if (hasArgument(argc, argv, modes[j])) return true;
+  }
+  return false;
+}
+
+int run(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+
+  QCoreApplication::setOrganizationName("Libki");
+  QCoreApplication::setOrganizationDomain("libki.org");
+  QCoreApplication::setApplicationName("Libki Kiosk Management System");
+  QSettings::setDefaultFormat(QSettings::IniFormat);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Libki client developer tools");
+  parser.addHelpOption();
+
+  QCommandLineOption fleetOption("fleet", "Simulate <count> nodes.", "count");
+  QCommandLineOption mockServerOption(
+      "mock-server", "Serve a mock of the server's client API.");
+  QCommandLineOption serverOption("server", "Server the fleet loads.", "url",
+                                  "http://127.0.0.1:3000");
+  QCommandLineOption portOption("port", "Port of the mock server.", "port",
+                                "3000");
+  QCommandLineOption userPrefixOption(
+      "user-prefix", "Fleet patrons are named <prefix>1 to <prefix><count>.",
+      "prefix", "fleet");
+  QCommandLineOption passwordOption(
+      "password", "Password of the fleet patrons, or the only one the mock "
+                  "server accepts.",
+      "password");
+  QCommandLineOption durationOption("duration", "Seconds the fleet runs for.",
+                                    "seconds", "300");
+  QCommandLineOption verboseOption("verbose", "Keep the client's debug log.");
+  parser.addOption(fleetOption);
+  parser.addOption(mockServerOption);
+  parser.addOption(serverOption);
+  parser.addOption(portOption);
+  parser.addOption(userPrefixOption);
+  parser.addOption(passwordOption);
+  parser.addOption(durationOption);
+  parser.addOption(verboseOption);
+  parser.process(app);
+
+  if (!parser.isSet(verboseOption)) {
+    qInstallMessageHandler(quietMessageHandler);
+  }
+
+  qsrand(uint(QDateTime::currentMSecsSinceEpoch()));
+
+  if (parser.isSet(mockServerOption)) {
+    MockServer *server = new MockServer(&app);
+    server->setPassword(parser.value(passwordOption));
+    if (!server->listen(quint16(parser.value(portOption).toInt()))) {
+      fprintf(stderr, "Unable to listen on port %s\n",
+              parser.value(portOption).toLocal8Bit().constData());
+      return 1;
+    }
+    QTextStream(stdout) << QString("MOCK SERVER: http://127.0.0.1:%1\n")
+                               .arg(server->port());
+    return app.exec();
+  }
+
+  FleetSimulator *simulator =
+      new FleetSimulator(QUrl(parser.value(serverOption)),
+                         qMax(parser.value(fleetOption).toInt(), 1), &app);
+  simulator->setCredentials(
+      parser.value(userPrefixOption),
+      parser.isSet(passwordOption) ? parser.value(passwordOption) : "fleet");
+  simulator->setDuration(qMax(parser.value(durationOption).toInt(), 1));
+  simulator->start();
+
+  return app.exec();
+}
+
+}  // namespace DevTools
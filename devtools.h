@@ -0,0 +1,37 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DEVTOOLS_H
+#define DEVTOOLS_H
+
+/* Headless developer modes, only built with "qmake CONFIG+=devtools":
+ *   --fleet N      simulated nodes loading a server, see FleetSimulator
+ *   --mock-server  a stand-in for the server's client API, see MockServer
+ * LIBKI_FAULTS or the [faults] settings inject faults into the kiosk itself,
+ * see FaultInjector. */
+namespace DevTools {
+
+// True when the command line asks for one of the modes, checked before the
+// kiosk's QApplication is created
+bool requested(int argc, char *argv[]);
+
+// Runs the requested mode and returns the exit code
+int run(int argc, char *argv[]);
+
+}  // namespace DevTools
+
+#endif  // DEVTOOLS_H
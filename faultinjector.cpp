@@ -0,0 +1,361 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "faultinjector.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSettings>
+#include <QStringList>
+#include <QTimer>
+#include <QUrlQuery>
+
+#ifndef QT_NO_SSL
+#include <QSslConfiguration>
+#include <QSslError>
+#endif  // ifndef QT_NO_SSL
+
+// Milliseconds before a dropped request times out, the client itself waits
+// forever
+#define DROP_TIMEOUT 60000
+
+static QMutex rulesMutex;
+static QHash<QString, FaultRule> faultRules;
+static bool rulesLoaded = false;
+static bool rulesSet = false;
+
+static double uniform() { return qrand() / (double(RAND_MAX) + 1); }
+
+FaultRule FaultRule::parse(const QString &spec) {
+  FaultRule rule;
+
+  foreach (const QString &entry, spec.split(',', QString::SkipEmptyParts)) {
+    QStringList parts = entry.trimmed().split(':');
+    QString kind = parts.at(0);
+
+    if (kind == "latency" && parts.size() == 3 && parts.at(1) == "exp") {
+      rule.latencyMean = parts.at(2).toInt();
+    } else if (kind == "latency" && parts.size() == 2) {
+      QStringList range = parts.at(1).split('-');
+      rule.latencyMin = range.at(0).toInt();
+      rule.latencyMax =
+          range.size() > 1 ? range.at(1).toInt() : rule.latencyMin;
+    } else if (kind == "drop" && parts.size() == 2) {
+      rule.dropRate = parts.at(1).toDouble();
+    } else if (kind == "reset" && parts.size() == 2) {
+      rule.resetRate = parts.at(1).toDouble();
+    } else if (kind == "truncate" && parts.size() == 2) {
+      rule.truncateRate = parts.at(1).toDouble();
+    } else if (kind == "error" && parts.size() >= 2) {
+      rule.errorRate = parts.at(1).toDouble();
+      if (parts.size() > 2) rule.errorStatus = parts.at(2).toInt();
+    } else {
+      qDebug() << "FAULTS: ignoring " << entry;
+    }
+  }
+
+  return rule;
+}
+
+FaultInjector::FaultInjector(QObject *parent) : QNetworkAccessManager(parent) {
+  qDebug("ENTER FaultInjector::FaultInjector");
+
+  // The real requests run here, this manager only hands out the damaged
+  // copies of their replies
+  transport = new QNetworkAccessManager(this);
+
+  qDebug("LEAVE FaultInjector::FaultInjector");
+}
+
+/* Rules are written as "action=rule;action=rule" */
+QHash<QString, FaultRule> FaultInjector::parseRules(const QString &spec) {
+  QHash<QString, FaultRule> rules;
+
+  foreach (const QString &entry, spec.split(';', QString::SkipEmptyParts)) {
+    int equals = entry.indexOf('=');
+    if (equals < 0) continue;
+
+    rules.insert(entry.left(equals).trimmed(),
+                 FaultRule::parse(entry.mid(equals + 1)));
+  }
+
+  return rules;
+}
+
+static void loadRules() {
+  if (rulesLoaded) return;
+  rulesLoaded = true;
+
+  QByteArray environment = qgetenv("LIBKI_FAULTS");
+  if (!environment.isEmpty()) {
+    faultRules = FaultInjector::parseRules(QString::fromUtf8(environment));
+  } else {
+    QSettings settings;
+    settings.setIniCodec("UTF-8");
+    settings.beginGroup("faults");
+    foreach (const QString &action, settings.childKeys()) {
+      faultRules.insert(action,
+                        FaultRule::parse(settings.value(action).toString()));
+    }
+  }
+
+  if (!faultRules.isEmpty()) {
+    qDebug() << "FAULTS: injecting faults for " << faultRules.keys();
+  }
+}
+
+bool FaultInjector::isEnabled() {
+  QMutexLocker locker(&rulesMutex);
+  loadRules();
+  return rulesSet || !faultRules.isEmpty();
+}
+
+void FaultInjector::setRules(const QHash<QString, FaultRule> &rules) {
+  QMutexLocker locker(&rulesMutex);
+  rulesLoaded = true;
+  rulesSet = true;
+  faultRules = rules;
+}
+
+QNetworkReply *FaultInjector::createRequest(Operation operation,
+                                            const QNetworkRequest &request,
+                                            QIODevice *outgoingData) {
+  QString action = QUrlQuery(request.url()).queryItemValue("action");
+  if (action.isEmpty()) action = request.url().path().section('/', -1);
+
+  FaultRule rule;
+  {
+    QMutexLocker locker(&rulesMutex);
+    loadRules();
+    rule = faultRules.contains(action) ? faultRules.value(action)
+                                       : faultRules.value("default");
+  }
+
+  Fault::Enum fault = Fault::None;
+  double roll = uniform();
+  if ((roll -= rule.dropRate) < 0) {
+    fault = Fault::Drop;
+  } else if ((roll -= rule.resetRate) < 0) {
+    fault = Fault::Reset;
+  } else if ((roll -= rule.errorRate) < 0) {
+    fault = Fault::Error;
+  } else if ((roll -= rule.truncateRate) < 0) {
+    fault = Fault::Truncate;
+  }
+
+  int latency = rule.latencyMin;
+  if (rule.latencyMax > rule.latencyMin) {
+    latency += qrand() % (rule.latencyMax - rule.latencyMin + 1);
+  }
+  if (rule.latencyMean > 0) {
+    latency += int(-rule.latencyMean * log(1 - uniform()));
+  }
+  if (fault == Fault::Drop) latency = DROP_TIMEOUT;
+
+  // Only lost replies reach the server, dropped requests and proxy errors
+  // don't get past the proxy
+  QNetworkReply *inner = Q_NULLPTR;
+  if (fault != Fault::Drop && fault != Fault::Error) {
+    switch (operation) {
+      case GetOperation:
+        inner = transport->get(request);
+        break;
+      case PostOperation:
+        inner = transport->post(request, outgoingData);
+        break;
+      case PutOperation:
+        inner = transport->put(request, outgoingData);
+        break;
+      case HeadOperation:
+        inner = transport->head(request);
+        break;
+      case DeleteOperation:
+        inner = transport->deleteResource(request);
+        break;
+      default:
+        inner = transport->sendCustomRequest(
+            request,
+            request.attribute(QNetworkRequest::CustomVerbAttribute)
+                .toByteArray(),
+            outgoingData);
+        break;
+    }
+  }
+
+  return new FaultyNetworkReply(inner, request, operation, fault,
+                                rule.errorStatus, latency, this);
+}
+
+FaultyNetworkReply::FaultyNetworkReply(
+    QNetworkReply *inner, const QNetworkRequest &request,
+    QNetworkAccessManager::Operation operation, Fault::Enum fault,
+    int errorStatus, int latencyMsecs, QObject *parent)
+    : QNetworkReply(parent),
+      inner(inner),
+      fault(fault),
+      errorStatus(errorStatus),
+      latency(latencyMsecs),
+      offset(0) {
+  setRequest(request);
+  setUrl(request.url());
+  setOperation(operation);
+  open(QIODevice::ReadOnly);
+
+  if (!inner) {
+    QTimer::singleShot(latency, this, SLOT(deliver()));
+    return;
+  }
+
+  inner->setParent(this);
+  connect(inner, SIGNAL(finished()), this, SLOT(innerFinished()));
+  connect(inner, SIGNAL(uploadProgress(qint64, qint64)), this,
+          SIGNAL(uploadProgress(qint64, qint64)));
+#ifndef QT_NO_SSL
+  connect(inner, SIGNAL(encrypted()), this, SIGNAL(encrypted()));
+  connect(inner, SIGNAL(sslErrors(QList<QSslError>)), this,
+          SLOT(forwardSslErrors(QList<QSslError>)));
+#endif  // ifndef QT_NO_SSL
+}
+
+static QNetworkReply::NetworkError errorForStatus(int status) {
+  switch (status) {
+    case 500:
+      return QNetworkReply::InternalServerError;
+    case 501:
+      return QNetworkReply::OperationNotImplementedError;
+    case 503:
+      return QNetworkReply::ServiceUnavailableError;
+    default:
+      return QNetworkReply::UnknownServerError;
+  }
+}
+
+/* Copies the real reply, it is damaged and delivered once the latency has
+ * passed */
+void FaultyNetworkReply::innerFinished() {
+  content = inner->readAll();
+
+  setAttribute(QNetworkRequest::HttpStatusCodeAttribute,
+               inner->attribute(QNetworkRequest::HttpStatusCodeAttribute));
+  setAttribute(QNetworkRequest::HttpReasonPhraseAttribute,
+               inner->attribute(QNetworkRequest::HttpReasonPhraseAttribute));
+  foreach (const RawHeaderPair &header, inner->rawHeaderPairs()) {
+    setRawHeader(header.first, header.second);
+  }
+  if (inner->error() != QNetworkReply::NoError) {
+    setError(inner->error(), inner->errorString());
+  }
+
+  QTimer::singleShot(latency, this, SLOT(deliver()));
+}
+
+void FaultyNetworkReply::deliver() {
+  if (isFinished()) return;
+
+  switch (fault) {
+    case Fault::Drop:
+      setError(QNetworkReply::TimeoutError, "Request dropped (injected)");
+      break;
+    case Fault::Reset:
+      content.clear();
+      setError(QNetworkReply::RemoteHostClosedError,
+               "Connection closed (injected)");
+      break;
+    case Fault::Truncate:
+      content.truncate(content.size() / 2);
+      break;
+    case Fault::Error:
+      content = "<html><body><h1>" + QByteArray::number(errorStatus) +
+                " Bad Gateway</h1></body></html>";
+      setRawHeader("Content-Type", "text/html");
+      setRawHeader("Content-Length", QByteArray::number(content.size()));
+      setAttribute(QNetworkRequest::HttpStatusCodeAttribute, errorStatus);
+      setAttribute(QNetworkRequest::HttpReasonPhraseAttribute, "Bad Gateway");
+      setError(errorForStatus(errorStatus),
+               QString("Server replied %1 (injected)").arg(errorStatus));
+      break;
+    default:
+      break;
+  }
+
+  emit metaDataChanged();
+  if (error() != QNetworkReply::NoError) emit error(error());
+
+  setFinished(true);
+  if (!content.isEmpty()) {
+    emit downloadProgress(content.size(), content.size());
+    emit readyRead();
+  }
+  emit finished();
+}
+
+void FaultyNetworkReply::abort() {
+  if (isFinished()) return;
+
+  if (inner) {
+    inner->disconnect(this);
+    inner->abort();
+  }
+
+  setError(QNetworkReply::OperationCanceledError, "Operation canceled");
+  emit error(error());
+  setFinished(true);
+  emit finished();
+}
+
+qint64 FaultyNetworkReply::bytesAvailable() const {
+  qint64 pending = isFinished() ? content.size() - offset : 0;
+  return QNetworkReply::bytesAvailable() + pending;
+}
+
+bool FaultyNetworkReply::isSequential() const { return true; }
+
+qint64 FaultyNetworkReply::readData(char *data, qint64 maxSize) {
+  if (!isFinished()) return 0;
+
+  qint64 count = qMin(maxSize, qint64(content.size()) - offset);
+  if (count <= 0) return -1;
+
+  memcpy(data, content.constData() + offset, size_t(count));
+  offset += count;
+  return count;
+}
+
+void FaultyNetworkReply::ignoreSslErrors() {
+  if (inner) inner->ignoreSslErrors();
+}
+
+#ifndef QT_NO_SSL
+void FaultyNetworkReply::forwardSslErrors(const QList<QSslError> &errors) {
+  emit sslErrors(errors);
+}
+
+void FaultyNetworkReply::ignoreSslErrorsImplementation(
+    const QList<QSslError> &errors) {
+  if (inner) inner->ignoreSslErrors(errors);
+}
+
+void FaultyNetworkReply::sslConfigurationImplementation(
+    QSslConfiguration &configuration) const {
+  if (inner) configuration = inner->sslConfiguration();
+}
+#endif  // ifndef QT_NO_SSL
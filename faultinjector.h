@@ -0,0 +1,141 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FAULTINJECTOR_H
+#define FAULTINJECTOR_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QPointer>
+#include <QString>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
+
+/* What goes wrong with the requests for one API action. Rates are
+ * probabilities between 0 and 1, at most one fault is picked per request.
+ * Written as comma separated entries, e.g.
+ * "latency:100-900,error:0.1:502,truncate:0.05":
+ *   latency:MS, latency:MIN-MAX, latency:exp:MEAN  fixed, uniform or
+ *                                                  exponential extra latency
+ *   drop:RATE     the request is never answered, it times out after 60 s
+ *   reset:RATE    the server handles the request, the reply is lost
+ *   truncate:RATE half of the reply body arrives
+ *   error:RATE[:STATUS]  the proxy answers with a 5xx, 502 by default */
+struct FaultRule {
+  FaultRule()
+      : latencyMin(0),
+        latencyMax(0),
+        latencyMean(0),
+        dropRate(0),
+        resetRate(0),
+        truncateRate(0),
+        errorRate(0),
+        errorStatus(502) {}
+
+  static FaultRule parse(const QString &spec);
+
+  int latencyMin;
+  int latencyMax;
+  int latencyMean;
+  double dropRate;
+  double resetRate;
+  double truncateRate;
+  double errorRate;
+  int errorStatus;
+};
+
+namespace Fault {
+enum Enum { None, Drop, Reset, Truncate, Error };
+}
+
+/* A reply passed through the fault injector. The real request, if any, runs
+ * on the injector's transport, its reply is copied, damaged and delivered
+ * late. */
+class FaultyNetworkReply : public QNetworkReply {
+  Q_OBJECT
+
+ public:
+  FaultyNetworkReply(QNetworkReply *inner, const QNetworkRequest &request,
+                     QNetworkAccessManager::Operation operation,
+                     Fault::Enum fault, int errorStatus, int latencyMsecs,
+                     QObject *parent = 0);
+
+  void abort();
+  qint64 bytesAvailable() const;
+  bool isSequential() const;
+
+ public slots:
+
+  void ignoreSslErrors();
+
+ protected:
+  qint64 readData(char *data, qint64 maxSize);
+#ifndef QT_NO_SSL
+  void ignoreSslErrorsImplementation(const QList<QSslError> &errors);
+  void sslConfigurationImplementation(QSslConfiguration &configuration) const;
+#endif  // ifndef QT_NO_SSL
+
+ private slots:
+
+  void innerFinished();
+  void deliver();
+#ifndef QT_NO_SSL
+  void forwardSslErrors(const QList<QSslError> &errors);
+#endif  // ifndef QT_NO_SSL
+
+ private:
+  QPointer<QNetworkReply> inner;
+  Fault::Enum fault;
+  int errorStatus;
+  int latency;
+
+  QByteArray content;
+  qint64 offset;
+};
+
+/* A network access manager that damages the client's traffic, to see how it
+ * copes with slow servers, lost and truncated replies and a failing reverse
+ * proxy. Rules are per API action ("login", "register_node", "print", ...),
+ * "default" applies to the rest. They are read from the LIBKI_FAULTS
+ * environment variable, e.g. "default=latency:exp:300;login=error:0.2:502",
+ * or the [faults] section of the settings. Only built into devtools
+ * builds. */
+class FaultInjector : public QNetworkAccessManager {
+  Q_OBJECT
+
+ public:
+  FaultInjector(QObject *parent = 0);
+
+  // True when rules are configured or have been set
+  static bool isEnabled();
+
+  // Replaces the rules of every injector, e.g. to end a simulated outage
+  static void setRules(const QHash<QString, FaultRule> &rules);
+  static QHash<QString, FaultRule> parseRules(const QString &spec);
+
+ protected:
+  QNetworkReply *createRequest(Operation operation,
+                               const QNetworkRequest &request,
+                               QIODevice *outgoingData = 0);
+
+ private:
+  QNetworkAccessManager *transport;
+};
+
+#endif  // FAULTINJECTOR_H
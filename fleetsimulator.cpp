@@ -0,0 +1,277 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fleetsimulator.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QStringList>
+#include <QTextStream>
+
+#include "networkclient.h"
+#include "scheduler.h"
+
+// Seconds before a node's first login
+#define FIRST_LOGIN_SPREAD 30
+// Seconds a simulated patron stays logged in
+#define SESSION_MIN 60
+#define SESSION_MAX 300
+// Seconds into the session the patron prints
+#define PRINT_MIN 10
+#define PRINT_MAX 30
+#define PRINT_JOB_BYTES (64 * 1024)
+// Seconds between a logout and the next patron
+#define THINK_MIN 10
+#define THINK_MAX 60
+// Seconds before a failed logout is retried
+#define LOGOUT_RETRY 5
+
+FleetSimulator::FleetSimulator(const QUrl &server, int nodeCount,
+                               QObject *parent)
+    : QObject(parent), server(server) {
+  qDebug("ENTER FleetSimulator::FleetSimulator");
+
+  userPrefix = "fleet";
+  password = "fleet";
+  duration = 300;
+  lastReport = 0;
+
+  for (int i = 0; i < nodeCount; i++) {
+    // Locally administered MAC addresses and a private network, so the
+    // simulated nodes can't be mistaken for real ones on the server
+    QString name = QString("fleet-%1").arg(i + 1, 4, 10, QChar('0'));
+    QString mac = QString("02:00:00:%1:%2:%3")
+                      .arg((i >> 16) & 0xff, 2, 16, QChar('0'))
+                      .arg((i >> 8) & 0xff, 2, 16, QChar('0'))
+                      .arg(i & 0xff, 2, 16, QChar('0'));
+    QString ip = QString("10.%1.%2.%3")
+                     .arg((i >> 16) & 0xff)
+                     .arg((i >> 8) & 0xff)
+                     .arg(i & 0xff);
+
+    NetworkClient *client = new NetworkClient();
+    client->setParent(this);
+    client->simulateNode(name, ip, mac, server);
+
+    connect(client, SIGNAL(requestFinished(QString, qint64, bool)), this,
+            SLOT(recordRequest(QString, qint64, bool)));
+    connect(client, SIGNAL(loginSucceeded(QString, QString, int, int)), this,
+            SLOT(handleLoginSucceeded()));
+    connect(client, SIGNAL(loginFailed(QString)), this,
+            SLOT(handleLoginFailed()));
+    connect(client, SIGNAL(logoutSucceeded()), this,
+            SLOT(handleLogoutSucceeded()));
+    connect(client, SIGNAL(logoutFailed()), this, SLOT(handleLogoutFailed()));
+
+    Node node;
+    node.client = client;
+    node.state = Idle;
+    node.nextAction = 0;
+    node.printAt = -1;
+    nodes << node;
+    nodeIndexes.insert(client, i);
+  }
+
+  qDebug("LEAVE FleetSimulator::FleetSimulator");
+}
+
+void FleetSimulator::setCredentials(const QString &aUserPrefix,
+                                    const QString &aPassword) {
+  userPrefix = aUserPrefix;
+  password = aPassword;
+}
+
+void FleetSimulator::setDuration(int seconds) { duration = seconds; }
+
+void FleetSimulator::start() {
+  qDebug("ENTER FleetSimulator::start");
+
+  clock.start();
+
+  for (int i = 0; i < nodes.size(); i++) {
+    Node &node = nodes[i];
+    node.username = QString("%1%2").arg(userPrefix).arg(i + 1);
+    node.nextAction = randomMsecs(0, FIRST_LOGIN_SPREAD);
+    node.client->start();
+  }
+
+  Scheduler *scheduler = Scheduler::instance();
+  scheduler->addJob("fleetStep", 1000, this, "step", true);
+  scheduler->addJob("fleetReport", 1000 * 10, this, "report", true);
+  scheduler->addJob("fleetFinish", 0, this, "finish");
+  scheduler->start("fleetStep");
+  scheduler->start("fleetReport");
+  scheduler->startOnce("fleetFinish", 1000 * duration);
+
+  QTextStream(stdout) << QString("FLEET: %1 nodes against %2 for %3 s\n")
+                             .arg(nodes.size())
+                             .arg(server.toString())
+                             .arg(duration);
+
+  qDebug("LEAVE FleetSimulator::start");
+}
+
+/* Moves every patron along their script: login, print, logout, think */
+void FleetSimulator::step() {
+  qint64 now = clock.elapsed();
+
+  for (int i = 0; i < nodes.size(); i++) {
+    Node &node = nodes[i];
+
+    if (node.state == Idle && now >= node.nextAction) {
+      node.state = LoggingIn;
+      node.client->attemptLogin(node.username, password);
+    } else if (node.state == LoggedIn) {
+      if (node.printAt >= 0 && now >= node.printAt) {
+        node.printAt = -1;
+        node.client->simulatePrintJob(PRINT_JOB_BYTES);
+      }
+
+      if (now >= node.nextAction) {
+        node.state = LoggingOut;
+        node.client->attemptLogout();
+      }
+    }
+  }
+}
+
+FleetSimulator::Node *FleetSimulator::senderNode() {
+  if (!nodeIndexes.contains(sender())) return Q_NULLPTR;
+  return &nodes[nodeIndexes.value(sender())];
+}
+
+void FleetSimulator::handleLoginSucceeded() {
+  Node *node = senderNode();
+  if (!node) return;
+
+  qint64 now = clock.elapsed();
+  node->state = LoggedIn;
+  node->nextAction = now + randomMsecs(SESSION_MIN, SESSION_MAX);
+  node->printAt = now + randomMsecs(PRINT_MIN, PRINT_MAX);
+}
+
+void FleetSimulator::handleLoginFailed() {
+  Node *node = senderNode();
+  if (!node) return;
+
+  node->state = Idle;
+  node->nextAction = clock.elapsed() + randomMsecs(THINK_MIN, THINK_MAX);
+}
+
+void FleetSimulator::handleLogoutSucceeded() {
+  Node *node = senderNode();
+  if (!node) return;
+
+  node->state = Idle;
+  node->printAt = -1;
+  node->nextAction = clock.elapsed() + randomMsecs(THINK_MIN, THINK_MAX);
+}
+
+void FleetSimulator::handleLogoutFailed() {
+  Node *node = senderNode();
+  if (!node) return;
+
+  node->state = LoggedIn;
+  node->nextAction = clock.elapsed() + 1000 * LOGOUT_RETRY;
+}
+
+void FleetSimulator::recordRequest(const QString &action, qint64 nsecs,
+                                   bool ok) {
+  Samples &windowSamples = window[action];
+  Samples &totalSamples = total[action];
+
+  windowSamples.nsecs << nsecs;
+  totalSamples.nsecs << nsecs;
+  if (!ok) {
+    windowSamples.errors++;
+    totalSamples.errors++;
+  }
+}
+
+qint64 FleetSimulator::randomMsecs(int minSeconds, int maxSeconds) const {
+  int range = 1000 * (maxSeconds - minSeconds);
+  return 1000 * qint64(minSeconds) + (range > 0 ? qrand() % range : 0);
+}
+
+void FleetSimulator::report() {
+  qint64 now = clock.elapsed();
+
+  int loggedIn = 0;
+  foreach (const Node &node, nodes) {
+    if (node.state == LoggedIn) loggedIn++;
+  }
+
+  printStatistics(QString("FLEET %1 s: %2 of %3 nodes logged in")
+                      .arg(now / 1000)
+                      .arg(loggedIn)
+                      .arg(nodes.size()),
+                  window, now - lastReport);
+
+  window.clear();
+  lastReport = now;
+}
+
+void FleetSimulator::finish() {
+  Scheduler::instance()->stop("fleetStep");
+  Scheduler::instance()->stop("fleetReport");
+
+  printStatistics(QString("FLEET TOTAL: %1 nodes").arg(nodes.size()), total,
+                  clock.elapsed());
+
+  // Fail the run when the server never answered, e.g. in CI
+  int requests = 0;
+  int errors = 0;
+  foreach (const Samples &samples, total) {
+    requests += samples.nsecs.size();
+    errors += samples.errors;
+  }
+  QCoreApplication::exit(requests > errors ? 0 : 1);
+}
+
+void FleetSimulator::printStatistics(const QString &title,
+                                     const QHash<QString, Samples> &samples,
+                                     qint64 msecs) const {
+  QTextStream out(stdout);
+  out << title << "\n";
+
+  QStringList actions = samples.keys();
+  actions.sort();
+  foreach (const QString &action, actions) {
+    QList<qint64> sorted = samples.value(action).nsecs;
+    if (sorted.isEmpty()) continue;
+    qSort(sorted);
+
+    QStringList percentiles;
+    QList<int> ranks;
+    ranks << 50 << 90 << 99;
+    foreach (int rank, ranks) {
+      int index = qMin(sorted.size() - 1, sorted.size() * rank / 100);
+      percentiles << QString("p%1 %2 ms")
+                         .arg(rank)
+                         .arg(sorted.at(index) / 1e6, 0, 'f', 1);
+    }
+
+    out << QString("  %1: %2 req/s, %3, %4 errors\n")
+               .arg(action, -24)
+               .arg(sorted.size() * 1000.0 / qMax(msecs, qint64(1)), 0, 'f',
+                    1)
+               .arg(percentiles.join(", "))
+               .arg(samples.value(action).errors);
+  }
+
+  out.flush();
+}
@@ -0,0 +1,98 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FLEETSIMULATOR_H
+#define FLEETSIMULATOR_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QUrl>
+
+class NetworkClient;
+
+/* Runs many simulated nodes in one headless process to load test a Libki
+ * server. Every node is a NetworkClient with its own name, MAC and IP
+ * address, registering and polling like a kiosk while patrons log in, print
+ * and log out. Request rates and latency percentiles per API action are
+ * printed every ten seconds and once the run is over.
+ *
+ * Only built with "qmake CONFIG+=devtools", run it with
+ * "libkiclient --fleet 500 --server http://127.0.0.1:3000". */
+class FleetSimulator : public QObject {
+  Q_OBJECT
+
+ public:
+  FleetSimulator(const QUrl &server, int nodeCount, QObject *parent = 0);
+
+  void setCredentials(const QString &userPrefix, const QString &password);
+  void setDuration(int seconds);
+  void start();
+
+ private slots:
+
+  void step();
+  void report();
+  void finish();
+
+  void recordRequest(const QString &action, qint64 nsecs, bool ok);
+  void handleLoginSucceeded();
+  void handleLoginFailed();
+  void handleLogoutSucceeded();
+  void handleLogoutFailed();
+
+ private:
+  enum State { Idle, LoggingIn, LoggedIn, LoggingOut };
+
+  struct Node {
+    NetworkClient *client;
+    State state;
+    qint64 nextAction;
+    qint64 printAt;
+    QString username;
+  };
+
+  struct Samples {
+    Samples() : errors(0) {}
+
+    QList<qint64> nsecs;
+    int errors;
+  };
+
+  QUrl server;
+  QString userPrefix;
+  QString password;
+  int duration;
+
+  QList<Node> nodes;
+  QHash<QObject *, int> nodeIndexes;
+
+  QElapsedTimer clock;
+  qint64 lastReport;
+  QHash<QString, Samples> window;
+  QHash<QString, Samples> total;
+
+  Node *senderNode();
+  qint64 randomMsecs(int minSeconds, int maxSeconds) const;
+  void printStatistics(const QString &title,
+                       const QHash<QString, Samples> &samples,
+                       qint64 msecs) const;
+};
+
+#endif  // FLEETSIMULATOR_H
@@ -0,0 +1,316 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "idlemonitor.h"
+
+#include <QCoreApplication>
+#include <QCursor>
+#include <QDebug>
+#include <QEvent>
+#include <QGuiApplication>
+#include <QLibrary>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif  // ifdef Q_OS_WIN
+
+#ifdef Q_OS_LINUX
+#include <time.h>
+#endif  // ifdef Q_OS_LINUX
+
+#ifdef QT_DBUS_LIB
+#include <QDBusConnection>
+#include <QDBusInterface>
+#include <QDBusReply>
+#endif  // ifdef QT_DBUS_LIB
+
+#ifdef Q_OS_WIN
+class WindowsIdleSource : public IdleSource {
+ public:
+  QString name() const { return "GetLastInputInfo"; }
+
+  bool isAvailable() { return idleMsecs() >= 0; }
+
+  qint64 idleMsecs() {
+    LASTINPUTINFO info;
+    info.cbSize = sizeof(LASTINPUTINFO);
+    if (!GetLastInputInfo(&info)) return -1;
+
+    // Both values are 32 bit tick counts, unsigned arithmetic handles wrapping
+    return DWORD(GetTickCount() - info.dwTime);
+  }
+};
+#endif  // ifdef Q_OS_WIN
+
+#ifdef Q_OS_LINUX
+/* The X11 screensaver extension is loaded at runtime so the client doesn't
+ * need to link against libXss on systems without X */
+class X11IdleSource : public IdleSource {
+ public:
+  X11IdleSource()
+      : display(Q_NULLPTR),
+        info(Q_NULLPTR),
+        xCloseDisplay(Q_NULLPTR),
+        xDefaultRootWindow(Q_NULLPTR),
+        xFree(Q_NULLPTR),
+        xScreenSaverQueryInfo(Q_NULLPTR) {}
+
+  ~X11IdleSource() {
+    if (info && xFree) xFree(info);
+    if (display && xCloseDisplay) xCloseDisplay(display);
+  }
+
+  QString name() const { return "XScreenSaver"; }
+
+  bool isAvailable() {
+    if (QGuiApplication::platformName() != "xcb") return false;
+
+    QLibrary x11("X11", 6);
+    QLibrary xss("Xss", 1);
+
+    XOpenDisplayFn xOpenDisplay = (XOpenDisplayFn)x11.resolve("XOpenDisplay");
+    xCloseDisplay = (XCloseDisplayFn)x11.resolve("XCloseDisplay");
+    xDefaultRootWindow =
+        (XDefaultRootWindowFn)x11.resolve("XDefaultRootWindow");
+    xFree = (XFreeFn)x11.resolve("XFree");
+    XScreenSaverQueryExtensionFn xScreenSaverQueryExtension =
+        (XScreenSaverQueryExtensionFn)xss.resolve(
+            "XScreenSaverQueryExtension");
+    XScreenSaverAllocInfoFn xScreenSaverAllocInfo =
+        (XScreenSaverAllocInfoFn)xss.resolve("XScreenSaverAllocInfo");
+    xScreenSaverQueryInfo =
+        (XScreenSaverQueryInfoFn)xss.resolve("XScreenSaverQueryInfo");
+
+    if (!xOpenDisplay || !xCloseDisplay || !xDefaultRootWindow || !xFree ||
+        !xScreenSaverQueryExtension || !xScreenSaverAllocInfo ||
+        !xScreenSaverQueryInfo) {
+      return false;
+    }
+
+    display = xOpenDisplay(Q_NULLPTR);
+    if (!display) return false;
+
+    int eventBase, errorBase;
+    if (!xScreenSaverQueryExtension(display, &eventBase, &errorBase)) {
+      return false;
+    }
+
+    info = xScreenSaverAllocInfo();
+    return info && idleMsecs() >= 0;
+  }
+
+  qint64 idleMsecs() {
+    if (!xScreenSaverQueryInfo(display, xDefaultRootWindow(display), info)) {
+      return -1;
+    }
+    return info->idle;
+  }
+
+ private:
+  struct XScreenSaverInfo {
+    unsigned long window;
+    int state;
+    int kind;
+    unsigned long tilOrSince;
+    unsigned long idle;
+    unsigned long eventMask;
+  };
+
+  typedef void *(*XOpenDisplayFn)(const char *);
+  typedef int (*XCloseDisplayFn)(void *);
+  typedef unsigned long (*XDefaultRootWindowFn)(void *);
+  typedef int (*XFreeFn)(void *);
+  typedef int (*XScreenSaverQueryExtensionFn)(void *, int *, int *);
+  typedef XScreenSaverInfo *(*XScreenSaverAllocInfoFn)();
+  typedef int (*XScreenSaverQueryInfoFn)(void *, unsigned long,
+                                         XScreenSaverInfo *);
+
+  void *display;
+  XScreenSaverInfo *info;
+  XCloseDisplayFn xCloseDisplay;
+  XDefaultRootWindowFn xDefaultRootWindow;
+  XFreeFn xFree;
+  XScreenSaverQueryInfoFn xScreenSaverQueryInfo;
+};
+#endif  // ifdef Q_OS_LINUX
+
+#if defined(Q_OS_LINUX) && defined(QT_DBUS_LIB)
+/* GNOME on Wayland doesn't let clients see global input, but Mutter exports
+ * the idle time on the session bus */
+class MutterIdleSource : public IdleSource {
+ public:
+  MutterIdleSource() : monitor(Q_NULLPTR) {}
+  ~MutterIdleSource() { delete monitor; }
+
+  QString name() const { return "Mutter IdleMonitor"; }
+
+  bool isAvailable() {
+    monitor = new QDBusInterface("org.gnome.Mutter.IdleMonitor",
+                                 "/org/gnome/Mutter/IdleMonitor/Core",
+                                 "org.gnome.Mutter.IdleMonitor",
+                                 QDBusConnection::sessionBus());
+    return monitor->isValid() && idleMsecs() >= 0;
+  }
+
+  qint64 idleMsecs() {
+    QDBusReply<qulonglong> reply = monitor->call("GetIdletime");
+    if (!reply.isValid()) return -1;
+    return reply.value();
+  }
+
+ private:
+  QDBusInterface *monitor;
+};
+
+/* logind only knows the session is idle once the desktop environment tells it
+ * so, only use it on Wayland sessions where the hint is actually maintained */
+class LogindIdleSource : public IdleSource {
+ public:
+  LogindIdleSource() : session(Q_NULLPTR) {}
+  ~LogindIdleSource() { delete session; }
+
+  QString name() const { return "logind IdleHint"; }
+
+  bool isAvailable() {
+    if (QGuiApplication::platformName() != "wayland") return false;
+
+    session = new QDBusInterface("org.freedesktop.login1",
+                                 "/org/freedesktop/login1/session/self",
+                                 "org.freedesktop.login1.Session",
+                                 QDBusConnection::systemBus());
+    return session->isValid() &&
+           session->property("IdleSinceHintMonotonic").toULongLong() > 0;
+  }
+
+  qint64 idleMsecs() {
+    QVariant idleHint = session->property("IdleHint");
+    if (!idleHint.isValid()) return -1;
+    if (!idleHint.toBool()) return 0;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    qint64 nowUsecs = qint64(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+    qint64 sinceUsecs =
+        session->property("IdleSinceHintMonotonic").toLongLong();
+
+    return qMax(qint64(0), (nowUsecs - sinceUsecs) / 1000);
+  }
+
+ private:
+  QDBusInterface *session;
+};
+#endif  // if defined(Q_OS_LINUX) && defined(QT_DBUS_LIB)
+
+IdleMonitor::IdleMonitor(QObject *parent) : QObject(parent) {
+  qDebug("ENTER IdleMonitor::IdleMonitor");
+
+#ifdef Q_OS_WIN
+  sources.append(new WindowsIdleSource());
+#endif  // ifdef Q_OS_WIN
+#if defined(Q_OS_LINUX) && defined(QT_DBUS_LIB)
+  sources.append(new MutterIdleSource());
+#endif  // if defined(Q_OS_LINUX) && defined(QT_DBUS_LIB)
+#ifdef Q_OS_LINUX
+  sources.append(new X11IdleSource());
+#endif  // ifdef Q_OS_LINUX
+#if defined(Q_OS_LINUX) && defined(QT_DBUS_LIB)
+  sources.append(new LogindIdleSource());
+#endif  // if defined(Q_OS_LINUX) && defined(QT_DBUS_LIB)
+
+  source = Q_NULLPTR;
+  filteringEvents = false;
+  foreach (IdleSource *candidate, sources) {
+    if (candidate->isAvailable()) {
+      source = candidate;
+      break;
+    }
+  }
+
+  lastActivity.start();
+  lastCursorPos = QCursor::pos();
+
+  if (source) {
+    qDebug() << "IDLE SOURCE: " << source->name();
+  } else {
+    // Nothing system wide is available, timestamp the input we can see
+    qDebug() << "IDLE SOURCE: input events and cursor position";
+    filterEvents();
+  }
+
+  qDebug("LEAVE IdleMonitor::IdleMonitor");
+}
+
+IdleMonitor::~IdleMonitor() { qDeleteAll(sources); }
+
+QString IdleMonitor::sourceName() const {
+  return source ? source->name() : QString("events");
+}
+
+bool IdleMonitor::isPrecise() const {
+  return source != Q_NULLPTR && !filteringEvents;
+}
+
+qint64 IdleMonitor::idleMsecs() {
+  if (source) {
+    qint64 idle = source->idleMsecs();
+    if (idle >= 0) return idle;
+    qDebug() << "IDLE SOURCE FAILED: " << source->name();
+
+    // Keyboard input doesn't move the cursor, it has to be seen as well
+    if (!filteringEvents) {
+      filterEvents();
+      reset();
+    }
+  }
+
+  // Input outside of our own windows is only noticed through the cursor
+  QPoint pos = QCursor::pos();
+  if (pos != lastCursorPos) {
+    lastCursorPos = pos;
+    lastActivity.restart();
+  }
+
+  return lastActivity.elapsed();
+}
+
+void IdleMonitor::filterEvents() {
+  QCoreApplication::instance()->installEventFilter(this);
+  filteringEvents = true;
+}
+
+void IdleMonitor::reset() {
+  lastActivity.restart();
+  lastCursorPos = QCursor::pos();
+}
+
+bool IdleMonitor::eventFilter(QObject *target, QEvent *event) {
+  switch (event->type()) {
+    case QEvent::KeyPress:
+    case QEvent::MouseMove:
+    case QEvent::MouseButtonPress:
+    case QEvent::Wheel:
+    case QEvent::TouchBegin:
+    case QEvent::TouchUpdate:
+      lastActivity.restart();
+      break;
+
+    default:
+      break;
+  }
+
+  return QObject::eventFilter(target, event);
+}
@@ -0,0 +1,73 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDLEMONITOR_H
+#define IDLEMONITOR_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QPoint>
+#include <QString>
+
+/* A way of asking the system how long the user has been idle */
+class IdleSource {
+ public:
+  virtual ~IdleSource() {}
+
+  virtual QString name() const = 0;
+  virtual bool isAvailable() = 0;
+
+  // Milliseconds since the last keyboard or mouse input, -1 on failure
+  virtual qint64 idleMsecs() = 0;
+};
+
+/* Reports how long the patron has been idle. The first available system wide
+ * source is used (GetLastInputInfo on Windows, the Mutter idle monitor or the
+ * X11 screensaver extension, logind idle hints on Linux). When none is
+ * available, input events seen by the application and cursor movement are
+ * timestamped instead. */
+class IdleMonitor : public QObject {
+  Q_OBJECT
+
+ public:
+  IdleMonitor(QObject *parent = 0);
+  ~IdleMonitor();
+
+  qint64 idleMsecs();
+  QString sourceName() const;
+
+  // True when the source sees all input system wide, in which case the idle
+  // time doesn't need to be sampled and checks can be scheduled at deadlines
+  bool isPrecise() const;
+
+  void reset();
+
+  bool eventFilter(QObject *target, QEvent *event);
+
+ private:
+  QList<IdleSource *> sources;
+  IdleSource *source;
+  bool filteringEvents;
+
+  QElapsedTimer lastActivity;
+  QPoint lastCursorPos;
+
+  void filterEvents();
+};
+
+#endif  // IDLEMONITOR_H
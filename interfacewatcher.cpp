@@ -0,0 +1,116 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "interfacewatcher.h"
+
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif  // ifdef Q_OS_LINUX
+
+#include "scheduler.h"
+
+// Milliseconds without messages before a change is reported, bringing an
+// interface up sends several
+#define INTERFACE_SETTLE_DELAY 1000
+
+InterfaceWatcher::InterfaceWatcher(QObject *parent)
+    : QObject(parent), fd(-1), notifier(Q_NULLPTR) {
+  qDebug("ENTER InterfaceWatcher::InterfaceWatcher");
+
+  Scheduler::instance()->addJob("interfacesSettled", 0, this, "settled");
+
+#ifdef Q_OS_LINUX
+  fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+              NETLINK_ROUTE);
+  if (fd >= 0) {
+    struct sockaddr_nl address;
+    memset(&address, 0, sizeof(address));
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR;
+
+    if (bind(fd, reinterpret_cast<struct sockaddr *>(&address),
+             sizeof(address)) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+
+  if (fd >= 0) {
+    notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(notifier, SIGNAL(activated(int)), this, SLOT(readEvents()));
+  }
+#endif  // ifdef Q_OS_LINUX
+
+  if (!isActive()) {
+    qDebug() << "INTERFACES: not watched, the node keeps its identity from "
+                "startup";
+  }
+
+  qDebug("LEAVE InterfaceWatcher::InterfaceWatcher");
+}
+
+InterfaceWatcher::~InterfaceWatcher() {
+#ifdef Q_OS_LINUX
+  if (fd >= 0) close(fd);
+#endif  // ifdef Q_OS_LINUX
+}
+
+bool InterfaceWatcher::isActive() const { return fd >= 0; }
+
+void InterfaceWatcher::readEvents() {
+#ifdef Q_OS_LINUX
+  bool relevant = false;
+
+  char buffer[8192];
+  ssize_t length;
+  while ((length = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    int remaining = int(length);
+    for (struct nlmsghdr *header = reinterpret_cast<struct nlmsghdr *>(buffer);
+         NLMSG_OK(header, remaining);
+         header = NLMSG_NEXT(header, remaining)) {
+      switch (header->nlmsg_type) {
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+          relevant = true;
+          break;
+      }
+    }
+  }
+
+  // The kernel dropped messages, one of them may have been a change
+  if (length < 0 && errno == ENOBUFS) relevant = true;
+
+  if (relevant) {
+    Scheduler::instance()->startOnce("interfacesSettled",
+                                     INTERFACE_SETTLE_DELAY);
+  }
+#endif  // ifdef Q_OS_LINUX
+}
+
+void InterfaceWatcher::settled() {
+  qDebug("INTERFACES: changed");
+  emit changed();
+}
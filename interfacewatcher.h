@@ -0,0 +1,52 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INTERFACEWATCHER_H
+#define INTERFACEWATCHER_H
+
+#include <QObject>
+#include <QSocketNotifier>
+
+/* Tells when the machine's network interfaces or their IPv4 addresses
+ * change, e.g. after a DHCP renewal or a switch from the dock to Wi-Fi.
+ * Listens to the kernel's routing netlink messages on Linux, nothing is
+ * polled. A burst of messages is reported once, after it settled. Elsewhere
+ * isActive() is false and changed() is never emitted. */
+class InterfaceWatcher : public QObject {
+  Q_OBJECT
+
+ public:
+  InterfaceWatcher(QObject *parent = 0);
+  ~InterfaceWatcher();
+
+  bool isActive() const;
+
+ signals:
+
+  void changed();
+
+ private slots:
+
+  void readEvents();
+  void settled();
+
+ private:
+  int fd;
+  QSocketNotifier *notifier;
+};
+
+#endif  // INTERFACEWATCHER_H
@@ -0,0 +1,89 @@
+# The client's sources without main(), shared by Libki.pro and the QtTest
+# suite in tests/
+
+QT += core
+QT += gui
+QT += network
+QT += script
+QT += widgets
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+# QtWebKit is only needed for banners that are full web pages, images and
+# simple HTML are rendered natively. Build with "qmake CONFIG+=no_webkit" to
+# drop the dependency.
+!no_webkit {
+    QT += webkitwidgets
+    DEFINES += LIBKI_WITH_WEBKIT
+}
+
+# Used to ask the desktop session for the patron's idle time
+unix:!macx {
+    QT += dbus
+}
+
+# Developer tools that are not part of a kiosk install, the client side of
+# them is needed by the tests as well
+devtools {
+    DEFINES += LIBKI_DEVTOOLS
+    HEADERS += $$PWD/faultinjector.h \
+        $$PWD/mockserver.h \
+        $$PWD/trafficreplay.h
+    SOURCES += $$PWD/faultinjector.cpp \
+        $$PWD/mockserver.cpp \
+        $$PWD/trafficreplay.cpp
+}
+
+HEADERS += $$PWD/loginwindow.h \
+    $$PWD/networkclient.h \
+    $$PWD/timerwindow.h \
+    $$PWD/assetcache.h \
+    $$PWD/bannerview.h \
+    $$PWD/idlemonitor.h \
+    $$PWD/interfacewatcher.h \
+    $$PWD/sessionlockedwindow.h \
+    $$PWD/logutils.h \
+    $$PWD/memorycompactor.h \
+    $$PWD/metrics.h \
+    $$PWD/metricsserver.h \
+    $$PWD/notificationcenter.h \
+    $$PWD/perfutils.h \
+    $$PWD/processsupervisor.h \
+    $$PWD/scheduler.h \
+    $$PWD/sessioncheckpoint.h \
+    $$PWD/stallmonitor.h \
+    $$PWD/startupprofile.h \
+    $$PWD/timesplash.h \
+    $$PWD/tlssessioncache.h \
+    $$PWD/trafficcapture.h \
+    $$PWD/utils.h \
+    $$PWD/wakeonlan.h
+FORMS += $$PWD/loginwindow.ui \
+    $$PWD/timerwindow.ui \
+    $$PWD/sessionlockedwindow.ui
+RESOURCES += $$PWD/libki.qrc
+SOURCES += $$PWD/loginwindow.cpp \
+    $$PWD/networkclient.cpp \
+    $$PWD/timerwindow.cpp \
+    $$PWD/utils.cpp \
+    $$PWD/sessionlockedwindow.cpp \
+    $$PWD/assetcache.cpp \
+    $$PWD/bannerview.cpp \
+    $$PWD/idlemonitor.cpp \
+    $$PWD/interfacewatcher.cpp \
+    $$PWD/logutils.cpp \
+    $$PWD/memorycompactor.cpp \
+    $$PWD/metrics.cpp \
+    $$PWD/metricsserver.cpp \
+    $$PWD/notificationcenter.cpp \
+    $$PWD/perfutils.cpp \
+    $$PWD/processsupervisor.cpp \
+    $$PWD/scheduler.cpp \
+    $$PWD/sessioncheckpoint.cpp \
+    $$PWD/stallmonitor.cpp \
+    $$PWD/startupprofile.cpp \
+    $$PWD/timesplash.cpp \
+    $$PWD/tlssessioncache.cpp \
+    $$PWD/trafficcapture.cpp \
+    $$PWD/wakeonlan.cpp
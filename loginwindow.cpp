@@ -23,8 +23,13 @@
 #include <QMessageBox>
 #include <QTextEdit>
 
+#include "perfutils.h"
+#include "processsupervisor.h"
 #include "utils.h"
 
+// Milliseconds from a logout until the login screen is back
+#define LOGIN_SCREEN_BUDGET 100
+
 LoginWindow::LoginWindow(QWidget *parent) : QMainWindow(parent) {
   qDebug("ENTER LoginWindow::LoginWindow");
 
@@ -68,11 +73,25 @@ LoginWindow::LoginWindow(QWidget *parent) : QMainWindow(parent) {
 
 LoginWindow::~LoginWindow() {}
 
+bool LoginWindow::eventFilter(QObject *target, QEvent *event) {
+  if (event->type() == QEvent::FocusIn || event->type() == QEvent::KeyPress) {
+    emit loginIntended();
+  }
+
+  return QMainWindow::eventFilter(target, event);
+}
+
 void LoginWindow::displayLoginWindow() {
   qDebug("ENTER LoginWindow::displayLoginWindow");
 
   showMe();
 
+  qint64 msecs = PerfUtils::endInterval("Logout to login screen");
+  if (msecs > LOGIN_SCREEN_BUDGET) {
+    qDebug() << "LOGOUT: login screen back after " << msecs << " ms, budget "
+             << LOGIN_SCREEN_BUDGET << " ms";
+  }
+
   qDebug("LEAVE LoginWindow::displayLoginWindow");
 }
 
@@ -82,6 +101,10 @@ void LoginWindow::setupActions() {
   connect(loginButton, SIGNAL(clicked()), this, SLOT(attemptLogin()));
   connect(cancelButton, SIGNAL(clicked()), this, SLOT(resetLoginScreen()));
 
+  // Typing is a good hint a login is coming, see eventFilter
+  usernameField->installEventFilter(this);
+  passwordField->installEventFilter(this);
+
   qDebug("LEAVE LoginWindow::setupActions");
 }
 
@@ -102,39 +125,6 @@ void LoginWindow::getSettings() {
     passwordLabel->setText(label);
   }
 
-  // Check for a local logo URL, then a server transmitted logo URL
-  QString logoUrl = settings.value("images/logo").toString();
-  int logoWidth = settings.value("images/logo_width").toInt();
-  int logoHeight = settings.value("images/logo_height").toInt();
-
-  if ( logoUrl.isEmpty() ) {
-    logoUrl = settings.value("session/LogoURL").toString();
-    logoWidth = settings.value("session/LogoWidth").toInt();
-    logoHeight = settings.value("session/LogoHeight").toInt();
-  }
-
-  if (!logoUrl.isEmpty()) {
-      qDebug() << "Logo URL: " << logoUrl;
-
-      logo->hide();
-
-      QPalette palette = logoWebView->palette();
-      palette.setBrush(QPalette::Base, Qt::transparent);
-
-      if (logoWidth) logoWebView->setMaximumWidth(logoWidth);
-      if (logoHeight) logoWebView->setMaximumHeight(logoHeight);
-
-      logoWebView->setEnabled(true);
-      logoWebView->page()->setPalette(palette);
-      logoWebView->setAttribute(Qt::WA_OpaquePaintEvent, false);
-      logoWebView->load(QUrl(logoUrl));
-
-      watermark->show();
-  } else {
-      logoWebView->hide();
-      watermark->hide();
-  }
-
   /* Hide Password Field */
 
   if (
@@ -225,6 +215,9 @@ void LoginWindow::attemptLogin() {
     }
   }
 
+  // Ends once the timer window is shown
+  PerfUtils::beginInterval("login");
+
   emit attemptLogin(username, password);
 
   qDebug("LEAVE LoginWindow::attemptLogin");
@@ -354,7 +347,9 @@ void LoginWindow::attemptLoginSuccess(QString username, QString password,
     }
 
     // Yes, these quotes around the command within string are required, IKR?
-    QProcess::startDetached('"' + runOnLogin + '"');
+    // Runs for the whole session, so it isn't supervised as a hook
+    ProcessSupervisor::instance()->detach("run_on_login",
+                                          '"' + runOnLogin + '"');
   }
 
   emit loginSucceeded(username, password, minutes, hold_items_count);
@@ -466,10 +461,6 @@ void LoginWindow::handleBanners() {
   QSettings settings;
   settings.setIniCodec("UTF-8");
 
-  QPalette palette = bannerWebViewTop->palette();
-
-  palette.setBrush(QPalette::Base, Qt::transparent);
-
   QString bannerTopUrl =
       "http://" + settings.value("session/BannerTopURL").toString();
 
@@ -478,8 +469,6 @@ void LoginWindow::handleBanners() {
     int bannerTopWidth = settings.value("session/BannerTopWidth").toInt();
 
     bannerWebViewTop->setEnabled(true);
-    bannerWebViewTop->page()->setPalette(palette);
-    bannerWebViewTop->setAttribute(Qt::WA_OpaquePaintEvent, false);
 
     if (bannerTopHeight) bannerWebViewTop->setMaximumHeight(bannerTopHeight);
 
@@ -496,8 +485,6 @@ void LoginWindow::handleBanners() {
     int bannerBottomWidth = settings.value("session/BannerBottomWidth").toInt();
 
     bannerWebViewBottom->setEnabled(true);
-    bannerWebViewBottom->page()->setPalette(palette);
-    bannerWebViewBottom->setAttribute(Qt::WA_OpaquePaintEvent, false);
 
     if (bannerBottomHeight)
       bannerWebViewBottom->setMaximumHeight(bannerBottomHeight);
@@ -507,35 +494,47 @@ void LoginWindow::handleBanners() {
     bannerWebViewBottom->load(QUrl(bannerBottomUrl));
   }
 
-  /* For when logo is specificed in server side setting */
-  if (!settings.value("images/logo").toString().isEmpty()) {
-    logo->hide();
+  showLogo();
 
-    QPalette palette = logoWebView->palette();
-    palette.setBrush(QPalette::Base, Qt::transparent);
+  qDebug("LEAVE LoginWindow::handleBanners");
+}
 
-    QString logoUrl = settings.value("images/logo").toString();
-    qDebug() << "Logo URL: " << logoUrl;
+void LoginWindow::showLogo() {
+  qDebug("ENTER LoginWindow::showLogo");
 
-    if (!logoUrl.isEmpty()) {
-      int logoWidth = settings.value("images/logo_width").toInt();
+  QSettings settings;
+  settings.setIniCodec("UTF-8");
 
-      if (logoWidth) logoWebView->setMaximumWidth(logoWidth);
+  // Check for a local logo URL, then a server transmitted logo URL
+  QString logoUrl = settings.value("images/logo").toString();
+  int logoWidth = settings.value("images/logo_width").toInt();
+  int logoHeight = settings.value("images/logo_height").toInt();
 
-      int logoHeight = settings.value("images/logo_height").toInt();
+  if ( logoUrl.isEmpty() ) {
+    logoUrl = settings.value("session/LogoURL").toString();
+    logoWidth = settings.value("session/LogoWidth").toInt();
+    logoHeight = settings.value("session/LogoHeight").toInt();
+  }
 
+  if (!logoUrl.isEmpty()) {
+      qDebug() << "Logo URL: " << logoUrl;
+
+      logo->hide();
+
+      if (logoWidth) logoWebView->setMaximumWidth(logoWidth);
       if (logoHeight) logoWebView->setMaximumHeight(logoHeight);
 
       logoWebView->setEnabled(true);
-      logoWebView->page()->setPalette(palette);
-      logoWebView->setAttribute(Qt::WA_OpaquePaintEvent, false);
       logoWebView->load(QUrl(logoUrl));
-    }
+      logoWebView->show();
+
+      watermark->show();
   } else {
-    logoWebView->hide();
+      logoWebView->hide();
+      watermark->hide();
   }
 
-  qDebug("LEAVE LoginWindow::handleBanners");
+  qDebug("LEAVE LoginWindow::showLogo");
 }
 
 void LoginWindow::disableLogin() {
@@ -582,3 +581,14 @@ void LoginWindow::showInternetAccessWarning(QString message) {
 
   qDebug("LEAVE LoginWindow::showInternetAccessWarning");
 }
+
+/* The stylesheet must be set from the GUI thread, this re-polishes every
+ * widget and is the most expensive thing the server can make us do */
+void LoginWindow::applyStyleSheet(const QString &styleSheet) {
+  qDebug("ENTER LoginWindow::applyStyleSheet");
+
+  PerfUtils::ScopedTimer perfTimer("QApplication::setStyleSheet");
+  qApp->setStyleSheet(styleSheet);
+
+  qDebug("LEAVE LoginWindow::applyStyleSheet");
+}
@@ -36,6 +36,7 @@ class LoginWindow : public QMainWindow, public Ui::LoginWindow {
   ~LoginWindow();
 
   void closeEvent(QCloseEvent* event);
+  bool eventFilter(QObject* target, QEvent* event);
 
  signals:
 
@@ -43,6 +44,7 @@ class LoginWindow : public QMainWindow, public Ui::LoginWindow {
                       const int& minutes, const int& hold_items_count);
   void attemptLogin(const QString& username, const QString& password);
   void displayingReservationMessage(QString reserved_for);
+  void loginIntended();
 
  public slots:
 
@@ -60,6 +62,8 @@ class LoginWindow : public QMainWindow, public Ui::LoginWindow {
   void showServerAccessWarning(QString message);
   void showInternetAccessWarning(QString message);
 
+  void applyStyleSheet(const QString &styleSheet);
+
  private slots:
 
   void resetLoginScreen();
@@ -74,6 +78,7 @@ class LoginWindow : public QMainWindow, public Ui::LoginWindow {
 
   void setupActions();
   void getSettings();
+  void showLogo();
   void showMe();
   void setButtonsEnabled(bool);
 };
@@ -20,20 +20,45 @@
 #include <stdlib.h>
 
 #include <QApplication>
+#include <QElapsedTimer>
 #include <QProcess>
 #include <QSettings>
-#include <QWebView>
+#include <QThread>
 
+#ifdef LIBKI_DEVTOOLS
+#include "devtools.h"
+#endif  // ifdef LIBKI_DEVTOOLS
 #include "loginwindow.h"
 #include "logutils.h"
+#include "memorycompactor.h"
 #include "networkclient.h"
+#include "perfutils.h"
+#include "processsupervisor.h"
+#include "stallmonitor.h"
+#include "startupprofile.h"
 #include "timerwindow.h"
+#include "utils.h"
 
 int main(int argc, char *argv[]) {
+  QElapsedTimer startupTimer;
+  startupTimer.start();
+  StartupProfile::begin(argc, argv);
+
+#ifdef LIBKI_DEVTOOLS
+  // The developer modes are headless, they must not lock down this machine
+  if (DevTools::requested(argc, argv)) {
+    return DevTools::run(argc, argv);
+  }
+#endif  // ifdef LIBKI_DEVTOOLS
+
   QApplication app(argc, argv);
 
   LogUtils::initLogging();
 
+  // Log the longest time per minute the GUI thread didn't process events
+  new StallMonitor(&app);
+  StartupProfile::phase("application and logging");
+
   QString os_username;
 
 #ifdef Q_OS_WIN
@@ -57,18 +82,25 @@ int main(int argc, char *argv[]) {
     qDebug() << "Translation file loaded" << filename;
   } else
     qDebug() << "Translation file not found:" << filename;
-
-  /* Apply the stylesheet */
-  QFile qss("libki.qss");
-  qss.open(QFile::ReadOnly);
-  app.setStyleSheet(qss.readAll());
-  qss.close();
+  StartupProfile::phase("translations");
 
   QCoreApplication::setOrganizationName("Libki");
   QCoreApplication::setOrganizationDomain("libki.org");
   QCoreApplication::setApplicationName("Libki Kiosk Management System");
   QSettings::setDefaultFormat(QSettings::IniFormat);
 
+  /* Apply the stylesheet, the last one pushed by the server takes precedence
+   * so the widgets don't have to be polished twice */
+  QString styleSheet = getCachedStyleSheet();
+  if (styleSheet.isEmpty()) {
+    QFile qss("libki.qss");
+    qss.open(QFile::ReadOnly);
+    styleSheet = qss.readAll();
+    qss.close();
+  }
+  app.setStyleSheet(styleSheet);
+  StartupProfile::phase("stylesheet");
+
   QSettings settings;
   settings.setIniCodec("UTF-8");
 
@@ -114,19 +146,57 @@ int main(int argc, char *argv[]) {
 
   // If this is an MS Windows platform, use the keylocker programs to limit
   // mischief.
-  QProcess::startDetached("taskkill /f /im explorer.exe");
-  QProcess::startDetached("windows/on_startup.exe");
+  ProcessSupervisor::instance()->detach("taskkill",
+                                        "taskkill /f /im explorer.exe");
+  // Blocks the hotkeys for as long as it runs, a hook timeout would kill it
+  ProcessSupervisor::instance()->detach("on_startup",
+                                        "windows/on_startup.exe");
 #endif  // ifdef Q_OS_WIN
 
+  // Once, so logging out runs only this desktop's command
+  ProcessSupervisor::detectDesktop();
+
   settings.setValue("session/ClientBehavior", "");
   settings.setValue("session/ReservationShowUsername", "");
   settings.setValue("session/LoggedInUser", "");
 
   settings.sync();
+  StartupProfile::phase("settings");
 
   LoginWindow *loginWindow = new LoginWindow();
+  StartupProfile::phase("login window");
   TimerWindow *timerWindow = new TimerWindow();
-  NetworkClient *networkClient = new NetworkClient( &app );
+  StartupProfile::phase("timer window");
+
+  // Only reads the settings, the node's identity is looked up and the node
+  // registered on the network thread while the login screen is already up
+  NetworkClient *networkClient = new NetworkClient();
+
+#ifdef LIBKI_DEVTOOLS
+  // "--replay FILE [--speed N]" plays a capture back into the kiosk, see
+  // TrafficReplay
+  QStringList arguments = app.arguments();
+  int replay = arguments.indexOf("--replay");
+  if (replay > 0 && replay + 1 < arguments.size()) {
+    int speed = arguments.indexOf("--speed");
+    double factor =
+        speed > 0 && speed + 1 < arguments.size()
+            ? qMax(arguments.at(speed + 1).toDouble(), 0.01)
+            : 1.0;
+    if (!networkClient->replayCapture(arguments.at(replay + 1), factor)) {
+      return 1;
+    }
+  }
+#endif  // ifdef LIBKI_DEVTOOLS
+
+  // Replies, settings syncs and print spool scans run on their own thread,
+  // everything below crosses threads through queued connections
+  QThread *networkThread = new QThread();
+  networkThread->setObjectName("NetworkClient");
+  networkClient->moveToThread(networkThread);
+  QObject::connect(networkThread, SIGNAL(started()), networkClient,
+                   SLOT(start()));
+  QObject::connect(&app, SIGNAL(aboutToQuit()), networkThread, SLOT(quit()));
 
   QObject::connect(
       loginWindow,
@@ -153,6 +223,9 @@ int main(int argc, char *argv[]) {
   QObject::connect(networkClient, SIGNAL(loginFailed(QString)), loginWindow,
                    SLOT(attemptLoginFailure(QString)));
 
+  QObject::connect(loginWindow, SIGNAL(loginIntended()), networkClient,
+                   SLOT(warmUpConnection()));
+
   QObject::connect(networkClient, SIGNAL(setReservationStatus(QString)),
                    loginWindow, SLOT(handleReservationStatus(QString)));
 
@@ -170,9 +243,18 @@ int main(int argc, char *argv[]) {
 
   QObject::connect(networkClient, SIGNAL(timeUpdatedFromServer(int)),
                    timerWindow, SLOT(updateTimeLeft(int)));
+  QObject::connect(timerWindow, SIGNAL(syncRequested()), networkClient,
+                   SLOT(getUserDataUpdate()));
+
+  QObject::connect(timerWindow, SIGNAL(sessionLockChanged(bool)),
+                   networkClient, SLOT(setSessionLocked(bool)));
+  QObject::connect(networkClient, SIGNAL(sessionLockRestored()), timerWindow,
+                   SLOT(lockSession()));
 
   QObject::connect(networkClient, SIGNAL(messageRecieved(QString)), timerWindow,
                    SLOT(showMessage(QString)));
+  QObject::connect(timerWindow, SIGNAL(messagesAcknowledged()), networkClient,
+                   SLOT(clearMessage()));
 
   QObject::connect(networkClient, SIGNAL(allowClose(bool)), loginWindow,
                    SLOT(setAllowClose(bool)));
@@ -184,7 +266,43 @@ int main(int argc, char *argv[]) {
   QObject::connect(networkClient, SIGNAL(internetAccessWarning(QString)), loginWindow,
                    SLOT(showInternetAccessWarning(QString)));
 
+  QObject::connect(networkClient, SIGNAL(styleSheetChanged(QString)),
+                   loginWindow, SLOT(applyStyleSheet(QString)));
+
+  // Memory left over from a session is given back while the login screen
+  // waits for the next patron
+  MemoryCompactor *memoryCompactor = new MemoryCompactor(&app);
+  QObject::connect(timerWindow, SIGNAL(timerStopped()), memoryCompactor,
+                   SLOT(schedule()));
+  QObject::connect(loginWindow, SIGNAL(loginIntended()), memoryCompactor,
+                   SLOT(postpone()));
+  QObject::connect(loginWindow,
+                   SIGNAL(loginSucceeded(QString, QString, int, int)),
+                   memoryCompactor, SLOT(cancel()));
+  QObject::connect(memoryCompactor, SIGNAL(releaseConnections()),
+                   networkClient, SLOT(releaseIdleConnections()));
+
+  StartupProfile::phase("network client");
+
+  networkThread->start();
+
   loginWindow->show();
+  StartupProfile::phase("login window shown");
+  StartupProfile::watchForInteractive();
+
+#ifdef LIBKI_WITH_WEBKIT
+  QString webkit = "with QtWebKit";
+#else
+  QString webkit = "without QtWebKit";
+#endif  // ifdef LIBKI_WITH_WEBKIT
+  qDebug() << QString("STARTUP: %1 ms, RSS %2 kB, built %3")
+                  .arg(startupTimer.elapsed())
+                  .arg(PerfUtils::residentSetSize())
+                  .arg(webkit);
+
+  int result = app.exec();
+
+  networkThread->wait();
 
-  return app.exec();
+  return result;
 }
@@ -0,0 +1,92 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "memorycompactor.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QPixmapCache>
+
+#ifdef LIBKI_WITH_WEBKIT
+#include <QWebSettings>
+#endif  // ifdef LIBKI_WITH_WEBKIT
+
+#if defined(Q_OS_LINUX) && defined(__GLIBC__)
+#include <malloc.h>
+#endif  // if defined(Q_OS_LINUX) && defined(__GLIBC__)
+
+#include "perfutils.h"
+#include "scheduler.h"
+
+// Milliseconds the login screen has to be idle after a logout
+#define COMPACT_DELAY 5000
+
+MemoryCompactor::MemoryCompactor(QObject *parent) : QObject(parent) {
+  qDebug("ENTER MemoryCompactor::MemoryCompactor");
+
+  pending = false;
+  Scheduler::instance()->addJob("compactMemory", 0, this, "compact");
+
+  qDebug("LEAVE MemoryCompactor::MemoryCompactor");
+}
+
+void MemoryCompactor::schedule() {
+  pending = true;
+  Scheduler::instance()->startOnce("compactMemory", COMPACT_DELAY);
+}
+
+/* Called while a patron types, the login screen isn't idle */
+void MemoryCompactor::postpone() {
+  if (pending) {
+    Scheduler::instance()->startOnce("compactMemory", COMPACT_DELAY);
+  }
+}
+
+void MemoryCompactor::cancel() {
+  pending = false;
+  Scheduler::instance()->stop("compactMemory");
+}
+
+void MemoryCompactor::compact() {
+  qDebug("ENTER MemoryCompactor::compact");
+
+  pending = false;
+
+  QElapsedTimer timer;
+  timer.start();
+  qint64 before = PerfUtils::residentSetSize();
+
+  emit releaseConnections();
+
+  QPixmapCache::clear();
+#ifdef LIBKI_WITH_WEBKIT
+  // Pages and images of the banners still shown are kept
+  QWebSettings::clearMemoryCaches();
+#endif  // ifdef LIBKI_WITH_WEBKIT
+
+#if defined(Q_OS_LINUX) && defined(__GLIBC__)
+  // glibc keeps freed memory in its arenas, return what it can to the OS
+  malloc_trim(0);
+#endif  // if defined(Q_OS_LINUX) && defined(__GLIBC__)
+
+  qDebug() << QString("COMPACT: RSS %1 kB before, %2 kB after, %3 ms")
+                  .arg(before)
+                  .arg(PerfUtils::residentSetSize())
+                  .arg(timer.elapsed());
+
+  qDebug("LEAVE MemoryCompactor::compact");
+}
@@ -0,0 +1,53 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEMORYCOMPACTOR_H
+#define MEMORYCOMPACTOR_H
+
+#include <QObject>
+
+/* Gives the previous session's memory back between sessions: WebKit's
+ * memory caches, cached pixmaps, idle connections to the server and, on
+ * Linux, the freed heap. Runs while the login screen sits idle after a
+ * logout, a patron starting to type postpones it and a login cancels it.
+ * The resident memory before and after is logged. */
+class MemoryCompactor : public QObject {
+  Q_OBJECT
+
+ public:
+  MemoryCompactor(QObject *parent = 0);
+
+ signals:
+
+  // Asks the network thread to close its idle connections
+  void releaseConnections();
+
+ public slots:
+
+  void schedule();
+  void postpone();
+  void cancel();
+
+ private slots:
+
+  void compact();
+
+ private:
+  bool pending;
+};
+
+#endif  // MEMORYCOMPACTOR_H
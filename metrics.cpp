@@ -0,0 +1,143 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metrics.h"
+
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QVector>
+
+namespace Metrics {
+
+enum Type { Counter, Gauge, Histogram };
+
+static const double histogramBuckets[] = {0.05, 0.1, 0.25, 0.5, 1,
+                                          2.5,  5,   10,   30};
+static const int histogramBucketCount =
+    sizeof(histogramBuckets) / sizeof(histogramBuckets[0]);
+
+struct Series {
+  Series() : value(0), count(0) {}
+
+  double value;  // The counter or gauge value, or the histogram sum
+  qint64 count;
+  QVector<qint64> buckets;
+};
+
+struct Family {
+  Family() : type(Counter) {}
+
+  Type type;
+  QMap<QString, Series> series;
+};
+
+static QMutex metricsMutex;
+static QMap<QString, Family> families;
+
+static Series& series(const QString& name, const QString& labels, Type type) {
+  Family& family = families[name];
+  family.type = type;
+  return family.series[labels];
+}
+
+void incrementCounter(const QString& name, const QString& labels,
+                      double value) {
+  QMutexLocker locker(&metricsMutex);
+  series(name, labels, Counter).value += value;
+}
+
+void setGauge(const QString& name, const QString& labels, double value) {
+  QMutexLocker locker(&metricsMutex);
+  series(name, labels, Gauge).value = value;
+}
+
+void observe(const QString& name, const QString& labels, double seconds) {
+  QMutexLocker locker(&metricsMutex);
+  Series& histogram = series(name, labels, Histogram);
+
+  if (histogram.buckets.isEmpty()) {
+    histogram.buckets.fill(0, histogramBucketCount);
+  }
+  for (int i = 0; i < histogramBucketCount; i++) {
+    if (seconds <= histogramBuckets[i]) histogram.buckets[i]++;
+  }
+  histogram.value += seconds;
+  histogram.count++;
+}
+
+static QString seriesName(const QString& name, const QString& labels,
+                          const QString& extra = QString()) {
+  QStringList all;
+  if (!labels.isEmpty()) all << labels;
+  if (!extra.isEmpty()) all << extra;
+  if (all.isEmpty()) return name;
+  return name + "{" + all.join(",") + "}";
+}
+
+QByteArray exposition() {
+  QMutexLocker locker(&metricsMutex);
+
+  QString text;
+  QMap<QString, Family>::const_iterator family;
+  for (family = families.constBegin(); family != families.constEnd();
+       ++family) {
+    const QString& name = family.key();
+    Type type = family.value().type;
+
+    text += QString("# TYPE %1 %2\n")
+                .arg(name)
+                .arg(type == Counter ? "counter"
+                                     : type == Gauge ? "gauge" : "histogram");
+
+    QMap<QString, Series>::const_iterator i;
+    for (i = family.value().series.constBegin();
+         i != family.value().series.constEnd(); ++i) {
+      const QString& labels = i.key();
+      const Series& s = i.value();
+
+      if (type != Histogram) {
+        text += QString("%1 %2\n")
+                    .arg(seriesName(name, labels))
+                    .arg(QString::number(s.value, 'g', 15));
+        continue;
+      }
+
+      for (int b = 0; b < histogramBucketCount; b++) {
+        text += QString("%1 %2\n")
+                    .arg(seriesName(
+                        name + "_bucket", labels,
+                        QString("le=\"%1\"").arg(histogramBuckets[b])))
+                    .arg(s.buckets.at(b));
+      }
+      text += QString("%1 %2\n")
+                  .arg(seriesName(name + "_bucket", labels, "le=\"+Inf\""))
+                  .arg(s.count);
+      text += QString("%1 %2\n")
+                  .arg(seriesName(name + "_sum", labels))
+                  .arg(QString::number(s.value, 'g', 15));
+      text += QString("%1 %2\n")
+                  .arg(seriesName(name + "_count", labels))
+                  .arg(s.count);
+    }
+  }
+
+  return text.toUtf8();
+}
+
+}  // namespace Metrics
@@ -0,0 +1,38 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QString>
+
+/* Process wide metrics in the Prometheus text format, served by the
+ * MetricsServer. Labels are passed preformatted, e.g. action="login".
+ * All functions are safe to call from any thread. */
+namespace Metrics {
+void incrementCounter(const QString& name, const QString& labels = QString(),
+                      double value = 1);
+void setGauge(const QString& name, const QString& labels, double value);
+
+// Latency histograms in seconds
+void observe(const QString& name, const QString& labels, double seconds);
+
+QByteArray exposition();
+}  // namespace Metrics
+
+#endif  // METRICS_H
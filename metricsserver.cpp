@@ -0,0 +1,96 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metricsserver.h"
+
+#include <QDebug>
+#include <QHostAddress>
+
+#include "metrics.h"
+#include "perfutils.h"
+
+// Requests larger than this are not a scraper's, drop them
+#define METRICS_MAX_REQUEST_SIZE 8192
+
+MetricsServer::MetricsServer(QObject *parent) : QObject(parent) {
+  server = new QTcpServer(this);
+  connect(server, SIGNAL(newConnection()), this, SLOT(acceptConnection()));
+}
+
+bool MetricsServer::listen(quint16 port) {
+  qDebug("ENTER MetricsServer::listen");
+
+  bool listening = server->listen(QHostAddress::LocalHost, port);
+  if (listening) {
+    qDebug() << "METRICS: serving http://127.0.0.1:" << port << "/metrics";
+  } else {
+    qDebug() << "METRICS: unable to listen on port " << port << ": "
+             << server->errorString();
+  }
+
+  qDebug("LEAVE MetricsServer::listen");
+  return listening;
+}
+
+void MetricsServer::acceptConnection() {
+  while (server->hasPendingConnections()) {
+    QTcpSocket *socket = server->nextPendingConnection();
+    connect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+    connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+  }
+}
+
+void MetricsServer::readRequest() {
+  QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+  if (!socket) return;
+
+  // Wait for the end of the headers, the request has no body
+  QByteArray request = socket->peek(METRICS_MAX_REQUEST_SIZE);
+  if (!request.contains("\r\n\r\n")) {
+    if (request.size() >= METRICS_MAX_REQUEST_SIZE) socket->abort();
+    return;
+  }
+  socket->readAll();
+
+  QList<QByteArray> requestLine =
+      request.left(request.indexOf("\r\n")).split(' ');
+  QByteArray path = requestLine.size() > 1 ? requestLine.at(1) : QByteArray();
+
+  QByteArray status;
+  QByteArray body;
+  if (requestLine.at(0) == "GET" && (path == "/metrics" || path == "/")) {
+    // Sampled on scrape, everything else is recorded as it happens
+    qint64 rss = PerfUtils::residentSetSize();
+    if (rss >= 0) {
+      Metrics::setGauge("libki_resident_memory_bytes", QString(), rss * 1024);
+    }
+
+    status = "200 OK";
+    body = Metrics::exposition();
+  } else {
+    status = "404 Not Found";
+    body = "Not Found\n";
+  }
+
+  socket->write("HTTP/1.0 " + status + "\r\n");
+  socket->write("Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n");
+  socket->write("Content-Length: " + QByteArray::number(body.size()) +
+                "\r\n");
+  socket->write("Connection: close\r\n\r\n");
+  socket->write(body);
+  socket->disconnectFromHost();
+}
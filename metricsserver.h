@@ -0,0 +1,45 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+/* Serves the client's metrics on http://127.0.0.1:<port>/metrics for a
+ * Prometheus scraper or node exporter running on the kiosk. Only enabled
+ * when metrics/enable is set, and only listens on the loopback interface. */
+class MetricsServer : public QObject {
+  Q_OBJECT
+
+ public:
+  MetricsServer(QObject *parent = 0);
+
+  bool listen(quint16 port);
+
+ private slots:
+
+  void acceptConnection();
+  void readRequest();
+
+ private:
+  QTcpServer *server;
+};
+
+#endif  // METRICSSERVER_H
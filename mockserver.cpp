@@ -0,0 +1,258 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mockserver.h"
+
+#include <QDebug>
+#include <QHostAddress>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QUrl>
+
+// Request headers larger than this are not the client's, drop them
+#define MOCK_MAX_HEADER_SIZE (64 * 1024)
+
+MockServer::MockServer(QObject *parent) : QObject(parent) {
+  sessionMinutes = 60;
+  total = 0;
+
+  server = new QTcpServer(this);
+  connect(server, SIGNAL(newConnection()), this, SLOT(acceptConnection()));
+}
+
+bool MockServer::listen(quint16 port) {
+  qDebug("ENTER MockServer::listen");
+
+  bool listening = server->listen(QHostAddress::LocalHost, port);
+  if (listening) {
+    qDebug() << "MOCK SERVER: serving http://127.0.0.1:" << server->serverPort();
+  } else {
+    qDebug() << "MOCK SERVER: unable to listen on port " << port << ": "
+             << server->errorString();
+  }
+
+  qDebug("LEAVE MockServer::listen");
+  return listening;
+}
+
+quint16 MockServer::port() const { return server->serverPort(); }
+
+void MockServer::setPassword(const QString &aPassword) {
+  password = aPassword;
+}
+
+void MockServer::setSessionMinutes(int minutes) { sessionMinutes = minutes; }
+
+int MockServer::requestCount(const QString &action) const {
+  return requests.value(action);
+}
+
+int MockServer::totalRequests() const { return total; }
+
+void MockServer::acceptConnection() {
+  while (server->hasPendingConnections()) {
+    QTcpSocket *socket = server->nextPendingConnection();
+    connect(socket, SIGNAL(readyRead()), this, SLOT(readRequests()));
+    connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    connect(socket, SIGNAL(destroyed(QObject *)), this,
+            SLOT(forgetSocket(QObject *)));
+  }
+}
+
+void MockServer::forgetSocket(QObject *socket) { buffers.remove(socket); }
+
+/* Answers every complete request in the buffer, the client keeps its
+ * connections open and may send the next request right away */
+void MockServer::readRequests() {
+  QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+  if (!socket) return;
+
+  QByteArray buffer = buffers.value(socket) + socket->readAll();
+
+  forever {
+    int headerEnd = buffer.indexOf("\r\n\r\n");
+    if (headerEnd < 0) {
+      if (buffer.size() > MOCK_MAX_HEADER_SIZE) {
+        socket->abort();
+        return;
+      }
+      break;
+    }
+
+    QList<QByteArray> lines = buffer.left(headerEnd).split('\n');
+    QList<QByteArray> requestLine = lines.at(0).trimmed().split(' ');
+    if (requestLine.size() < 3) {
+      socket->abort();
+      return;
+    }
+
+    bool keepAlive = requestLine.at(2) == "HTTP/1.1";
+    int contentLength = 0;
+    for (int i = 1; i < lines.size(); i++) {
+      int colon = lines.at(i).indexOf(':');
+      if (colon < 0) continue;
+
+      QByteArray name = lines.at(i).left(colon).trimmed().toLower();
+      QByteArray value = lines.at(i).mid(colon + 1).trimmed().toLower();
+      if (name == "content-length") {
+        contentLength = value.toInt();
+      } else if (name == "connection") {
+        keepAlive = value == "keep-alive";
+      }
+    }
+
+    // Wait for the rest of the body, print jobs arrive in several reads
+    int requestSize = headerEnd + 4 + contentLength;
+    if (buffer.size() < requestSize) break;
+    buffer.remove(0, requestSize);
+
+    int status = 200;
+    QByteArray body = handle(requestLine.at(0), requestLine.at(1), &status);
+
+    QByteArray reason = status == 200 ? "OK" : "Not Found";
+    socket->write("HTTP/1.1 " + QByteArray::number(status) + " " + reason +
+                  "\r\n");
+    socket->write("Content-Type: application/json\r\n");
+    socket->write("Content-Length: " + QByteArray::number(body.size()) +
+                  "\r\n");
+    socket->write(keepAlive ? "Connection: keep-alive\r\n\r\n"
+                            : "Connection: close\r\n\r\n");
+    socket->write(body);
+
+    if (!keepAlive) {
+      socket->disconnectFromHost();
+      return;
+    }
+  }
+
+  buffers.insert(socket, buffer);
+}
+
+QByteArray MockServer::handle(const QByteArray &method,
+                              const QByteArray &target, int *status) {
+  QUrl url(QString::fromLatin1(target));
+  QUrlQuery query(url);
+
+  QString action;
+  QByteArray reply;
+  if (method == "POST" && url.path() == "/api/client/v1_0/print") {
+    action = "print";
+    reply = "{\"success\":1}";
+  } else if (method == "GET" && url.path() == "/api/client/v1_0") {
+    action = query.queryItemValue("action");
+
+    if (action == "register_node") {
+      reply = registerNode(query);
+    } else if (action == "login") {
+      reply = login(query);
+    } else if (action == "logout") {
+      reply = logout(query);
+    } else if (action == "get_user_data") {
+      reply = userData(query);
+    } else if (action == "clear_message" ||
+               action == "acknowledge_reservation") {
+      reply = "{\"success\":1}";
+    }
+  }
+
+  if (reply.isEmpty()) {
+    *status = 404;
+    reply = "{\"error\":\"NOT_FOUND\"}";
+  }
+
+  requests[action.isEmpty() ? QString("unknown") : action]++;
+  total++;
+
+  return reply;
+}
+
+QByteArray MockServer::registerNode(const QUrlQuery &query) {
+  Q_UNUSED(query);
+
+  QJsonObject jo;
+  jo["registered"] = 1;
+  jo["status"] = QString("online");
+  jo["reserved_for"] = QString();
+  jo["ClientBehavior"] = QString("FCFS");
+  jo["ReservationShowUsername"] = QString("RSD");
+  jo["EnableClientSessionLocking"] = QString("0");
+  jo["EnableClientPasswordlessMode"] = QString("0");
+  jo["TermsOfService"] = QString();
+  jo["TermsOfServiceDetails"] = QString();
+  jo["inactivityLogout"] = QString("0");
+  jo["inactivityWarning"] = QString("0");
+  jo["InternetConnectivityURLs"] = QJsonValue();
+  jo["ClientTimeNotificationFrequency"] = QString("5");
+  jo["ClientTimeWarningThreshold"] = QString("5");
+
+  return QJsonDocument(jo).toJson(QJsonDocument::Compact);
+}
+
+QByteArray MockServer::login(const QUrlQuery &query) {
+  QString username = query.queryItemValue("username", QUrl::FullyDecoded);
+  QString given = query.queryItemValue("password", QUrl::FullyDecoded);
+
+  QJsonObject jo;
+  bool accepted = !username.isEmpty() &&
+                  (password.isEmpty() ? !given.isEmpty() : given == password);
+  if (accepted) {
+    if (!sessions.contains(username)) {
+      sessions.insert(username, QDateTime::currentDateTimeUtc());
+    }
+    jo["authenticated"] = 1;
+    jo["units"] = minutesLeft(username);
+    jo["hold_items_count"] = 0;
+  } else {
+    jo["authenticated"] = 0;
+    jo["error"] = QString("BAD_LOGIN");
+  }
+
+  return QJsonDocument(jo).toJson(QJsonDocument::Compact);
+}
+
+QByteArray MockServer::logout(const QUrlQuery &query) {
+  QString username = query.queryItemValue("username", QUrl::FullyDecoded);
+
+  QJsonObject jo;
+  jo["logged_out"] = sessions.remove(username) > 0 ? 1 : 0;
+
+  return QJsonDocument(jo).toJson(QJsonDocument::Compact);
+}
+
+QByteArray MockServer::userData(const QUrlQuery &query) {
+  QString username = query.queryItemValue("username", QUrl::FullyDecoded);
+
+  QJsonObject jo;
+  if (sessions.contains(username) && minutesLeft(username) > 0) {
+    jo["status"] = QString("Logged in");
+    jo["units"] = minutesLeft(username);
+    jo["messages"] = QJsonArray();
+  } else {
+    sessions.remove(username);
+    jo["status"] = QString("Logged out");
+  }
+
+  return QJsonDocument(jo).toJson(QJsonDocument::Compact);
+}
+
+int MockServer::minutesLeft(const QString &username) const {
+  qint64 elapsed =
+      sessions.value(username).secsTo(QDateTime::currentDateTimeUtc());
+  return qMax(0, sessionMinutes - int(elapsed / 60));
+}
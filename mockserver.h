@@ -0,0 +1,76 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrlQuery>
+
+/* A stand-in for the Libki server's client API (/api/client/v1_0 and
+ * /api/client/v1_0/print), enough for the client to register, log patrons
+ * in and out, poll, print and acknowledge reservations. Sessions are kept
+ * in memory and every request is counted per action. Plain HTTP with
+ * keep-alive, like the server behind a local reverse proxy. */
+class MockServer : public QObject {
+  Q_OBJECT
+
+ public:
+  MockServer(QObject *parent = 0);
+
+  // Port 0 picks a free port, see port()
+  bool listen(quint16 port);
+  quint16 port() const;
+
+  // Patrons log in with this password, any non-empty password when unset
+  void setPassword(const QString &password);
+  void setSessionMinutes(int minutes);
+
+  int requestCount(const QString &action) const;
+  int totalRequests() const;
+
+ private slots:
+
+  void acceptConnection();
+  void readRequests();
+  void forgetSocket(QObject *socket);
+
+ private:
+  QTcpServer *server;
+  QHash<QObject *, QByteArray> buffers;
+
+  QString password;
+  int sessionMinutes;
+  QHash<QString, QDateTime> sessions;
+  QHash<QString, int> requests;
+  int total;
+
+  QByteArray handle(const QByteArray &method, const QByteArray &target,
+                    int *status);
+  QByteArray registerNode(const QUrlQuery &query);
+  QByteArray login(const QUrlQuery &query);
+  QByteArray logout(const QUrlQuery &query);
+  QByteArray userData(const QUrlQuery &query);
+  int minutesLeft(const QString &username) const;
+};
+
+#endif  // MOCKSERVER_H
@@ -18,8 +18,24 @@
  */
 
 #include "networkclient.h"
+#ifdef LIBKI_DEVTOOLS
+#include "faultinjector.h"
+#include "trafficreplay.h"
+#endif  // ifdef LIBKI_DEVTOOLS
+#include "interfacewatcher.h"
+#include "metrics.h"
+#include "metricsserver.h"
+#include "perfutils.h"
+#include "processsupervisor.h"
+#include "scheduler.h"
+#include "startupprofile.h"
+#include "tlssessioncache.h"
+#include "trafficcapture.h"
 #include "utils.h"
+#include "wakeonlan.h"
 
+#include <QBuffer>
+#include <QCryptographicHash>
 #include <QDir>
 #include <QHttpMultiPart>
 #include <QJsonArray>
@@ -28,13 +44,22 @@
 #include <QJsonValue>
 #include <QList>
 #include <QSslError>
-#include <QUdpSocket>
 
 #define VERSION "2.2.27"
 
-NetworkClient::NetworkClient(QApplication *app) : QObject() {
+// Seconds before another warm up is attempted
+#define WARM_UP_INTERVAL 30
+// Default loopback port of the metrics endpoint
+#define METRICS_PORT 9188
+// Milliseconds before the first and the longest wait between print job
+// upload retries
+#define PRINT_RETRY_MIN 1000
+#define PRINT_RETRY_MAX 60000
+// Milliseconds each stage of the cleanup after a logout should take
+#define LOGOUT_STAGE_BUDGET 50
+
+NetworkClient::NetworkClient() : QObject() {
   qDebug("ENTER NetworkClient::NetworkClient");
-  this->app = app;
 
   qDebug() << "SSL version use for build: "
            << QSslSocket::sslLibraryBuildVersionString();
@@ -42,12 +67,28 @@ NetworkClient::NetworkClient(QApplication *app) : QObject() {
            << QSslSocket::sslLibraryVersionNumber();
 
   fileCounter = 0;
+  nam = Q_NULLPTR;
+  wakeOnLan = Q_NULLPTR;
+  printJobsInFlight = 0;
+  tlsSessionCache = Q_NULLPTR;
+  trafficCapture = Q_NULLPTR;
+  simulated = false;
+  replaying = false;
+#ifdef LIBKI_DEVTOOLS
+  trafficReplay = Q_NULLPTR;
+#endif  // ifdef LIBKI_DEVTOOLS
 
   QSettings settings;
   settings.setIniCodec("UTF-8");
 
   nodeName = getClientName();
 
+  QString cachedStyleSheet = getCachedStyleSheet();
+  if (!cachedStyleSheet.isEmpty()) {
+    styleSheetHash = QCryptographicHash::hash(cachedStyleSheet.toUtf8(),
+                                              QCryptographicHash::Sha1);
+  }
+
   nodeLocation = settings.value("node/location").toString();
   qDebug() << "LOCATION: " << nodeLocation;
   nodeType = settings.value("node/type").toString();
@@ -73,36 +114,346 @@ NetworkClient::NetworkClient(QApplication *app) : QObject() {
   serviceURL.setScheme(settings.value("server/scheme").toString());
   serviceURL.setPath("/api/client/v1_0");
 
-  nodeIPAddress = getIPv4Address();
-  nodeMACAddress = getMACAddress();
-  nodeHostname = getHostname();
+  qDebug("LEAVE NetworkClient::NetworkClient");
+}
 
+/* The node's identity is sent along with every request */
+void NetworkClient::updateUrlQuery() {
+  urlQuery = QUrlQuery();
   urlQuery.addQueryItem("node", nodeName);
   urlQuery.addQueryItem("location", nodeLocation);
   urlQuery.addQueryItem("type", nodeType);
   urlQuery.addQueryItem("ipaddress", nodeIPAddress);
   urlQuery.addQueryItem("macaddress", nodeMACAddress);
   urlQuery.addQueryItem("hostname", nodeHostname);
+}
 
+/* Called when the network interfaces changed. The server learns about a new
+ * address right away instead of with the next registration. */
+void NetworkClient::refreshIdentity() {
+  qDebug("ENTER NetworkClient::refreshIdentity");
+
+  clearNetworkIdentity();
+  QString ipAddress = getIPv4Address();
+  QString macAddress = getMACAddress();
+  QString hostname = getHostname();
+
+  // A DHCP renewal usually hands out the same address again
+  if (ipAddress == nodeIPAddress && macAddress == nodeMACAddress &&
+      hostname == nodeHostname) {
+    qDebug("LEAVE NetworkClient::refreshIdentity");
+    return;
+  }
+
+  qDebug() << "IDENTITY: " << nodeIPAddress << nodeMACAddress << nodeHostname
+           << " is now " << ipAddress << macAddress << hostname;
+  nodeIPAddress = ipAddress;
+  nodeMACAddress = macAddress;
+  nodeHostname = hostname;
+  updateUrlQuery();
+
+  // Connections made over the previous interface may be dead
+  nam->clearAccessCache();
   registerNode();
-  registerNodeTimer = new QTimer(this);
-  connect(registerNodeTimer, SIGNAL(timeout()), this, SLOT(registerNode()));
-  registerNodeTimer->start(1000 * 10);
 
-  checkForInternetConnectivity();
-  checkForInternetConnectivityTimer = new QTimer(this);
-  connect(checkForInternetConnectivityTimer, SIGNAL(timeout()), this, SLOT(checkForInternetConnectivity()));
-  checkForInternetConnectivityTimer->start(1000 * 10);
+  qDebug("LEAVE NetworkClient::refreshIdentity");
+}
+
+#ifdef LIBKI_DEVTOOLS
+void NetworkClient::simulateNode(const QString &name, const QString &ipAddress,
+                                 const QString &macAddress,
+                                 const QUrl &server) {
+  simulated = true;
 
-  uploadPrintJobsTimer = new QTimer(this);
-  connect(uploadPrintJobsTimer, SIGNAL(timeout()), this,
-          SLOT(uploadPrintJobs()));
+  nodeName = name;
+  nodeHostname = name;
+  nodeIPAddress = ipAddress;
+  nodeMACAddress = macAddress;
+  actionOnLogout = LogoutAction::NoAction;
 
-  updateUserDataTimer = new QTimer(this);
-  connect(updateUserDataTimer, SIGNAL(timeout()), this,
-          SLOT(getUserDataUpdate()));
+  serviceURL = server;
+  serviceURL.setPath("/api/client/v1_0");
 
-  qDebug("LEAVE NetworkClient::NetworkClient");
+  updateUrlQuery();
+}
+
+/* Uploads a print job of the given size without touching the spool
+ * directories */
+void NetworkClient::simulatePrintJob(int bytes) {
+  QBuffer *buffer = new QBuffer();
+  buffer->setData(QByteArray(bytes, '%'));
+  buffer->open(QIODevice::ReadOnly);
+
+  sendPrintJob("simulated",
+               QString("%1-%2.pdf").arg(nodeName).arg(fileCounter++), buffer);
+}
+
+bool NetworkClient::replayCapture(const QString &path, double speed) {
+  trafficReplay = new TrafficReplay(this, speed);
+  if (!trafficReplay->load(path)) {
+    delete trafficReplay;
+    trafficReplay = Q_NULLPTR;
+    return false;
+  }
+
+  // The replay must not run the recorded commands on this machine
+  simulated = true;
+  replaying = true;
+  actionOnLogout = LogoutAction::NoAction;
+  return true;
+}
+#endif  // ifdef LIBKI_DEVTOOLS
+
+/* Simulated nodes share the scheduler of their thread, their jobs are named
+ * after the node */
+QString NetworkClient::jobName(const QString &job) const {
+  return simulated ? nodeName + "/" + job : job;
+}
+
+/* Called once the client has been moved to its own thread, so the jobs are
+ * registered with that thread's scheduler and the network managers created
+ * by the jobs live there as well */
+void NetworkClient::start() {
+  qDebug("ENTER NetworkClient::start");
+
+  // One manager for every request keeps the connection to the server alive
+  // between the periodic requests, so a login doesn't pay for DNS, TCP and TLS
+#ifdef LIBKI_DEVTOOLS
+  if (trafficReplay) {
+    nam = trafficReplay;
+  } else if (FaultInjector::isEnabled()) {
+    nam = new FaultInjector(this);
+  } else {
+    nam = new QNetworkAccessManager(this);
+  }
+#else
+  nam = new QNetworkAccessManager(this);
+#endif  // ifdef LIBKI_DEVTOOLS
+  connect(nam, SIGNAL(finished(QNetworkReply *)), this,
+          SLOT(dispatchReply(QNetworkReply *)));
+  connect(nam, SIGNAL(sslErrors(QNetworkReply *, const QList<QSslError> &)),
+          this,
+          SLOT(handleSslErrors(QNetworkReply *, const QList<QSslError> &)));
+  connect(nam, SIGNAL(encrypted(QNetworkReply *)), this,
+          SLOT(handleEncrypted(QNetworkReply *)));
+
+  requestClock.start();
+
+  // Simulated nodes bring their own identity. Walking the interfaces is
+  // left to this thread, the login screen doesn't wait for it.
+  if (nodeIPAddress.isEmpty() && nodeMACAddress.isEmpty()) {
+    nodeIPAddress = getIPv4Address();
+    nodeMACAddress = getMACAddress();
+    nodeHostname = getHostname();
+    if (!simulated) StartupProfile::milestone("node identity");
+  }
+  updateUrlQuery();
+
+  if (!simulated) {
+    trafficCapture = TrafficCapture::fromSettings(nodeName);
+
+    tlsSessionCache =
+        new TlsSessionCache(serviceURL.host(), serviceURL.port());
+
+    wakeOnLan = new WakeOnLan(this);
+
+    InterfaceWatcher *interfaceWatcher = new InterfaceWatcher(this);
+    connect(interfaceWatcher, SIGNAL(changed()), this,
+            SLOT(refreshIdentity()));
+
+    QSettings metricsSettings;
+    metricsSettings.setIniCodec("UTF-8");
+    if (metricsSettings.value("metrics/enable").toString() == "1") {
+      MetricsServer *metricsServer = new MetricsServer(this);
+      metricsServer->listen(quint16(
+          metricsSettings.value("metrics/port", METRICS_PORT).toInt()));
+    }
+  }
+
+  Scheduler::instance()->addJob(jobName("retryPrintJobs"), 0, this,
+                                "retryPrintJobs");
+  Scheduler::instance()->addJob(jobName("runLogoutStage"), 0, this,
+                                "runLogoutStage");
+
+#ifdef LIBKI_DEVTOOLS
+  if (trafficReplay) {
+    trafficReplay->start();
+    qDebug("LEAVE NetworkClient::start");
+    return;
+  }
+#endif  // ifdef LIBKI_DEVTOOLS
+
+  // All periodic work shares the scheduler's aligned wakeups
+  Scheduler *scheduler = Scheduler::instance();
+  scheduler->addJob(jobName("registerNode"), 1000 * 10, this, "registerNode");
+  scheduler->addJob(jobName("checkForInternetConnectivity"), 1000 * 10, this,
+                    "checkForInternetConnectivity");
+  scheduler->addJob(jobName("uploadPrintJobs"), 1000 * 2, this,
+                    "uploadPrintJobs");
+  scheduler->addJob(jobName("resumeSession"), 1000 * 10, this,
+                    "resumeSession");
+
+  // The timer window counts down locally, the server only needs to be asked
+  // often enough to pick up messages and changes to the session
+  QSettings settings;
+  settings.setIniCodec("UTF-8");
+  int syncInterval = settings.value("node/syncInterval", 30).toInt();
+  scheduler->addJob(jobName("getUserDataUpdate"), 1000 * qMax(syncInterval, 1),
+                    this, "getUserDataUpdate");
+
+  if (simulated) {
+    // A real fleet doesn't poll in lockstep, spread the nodes over the
+    // intervals
+    scheduler->setPhase(jobName("registerNode"), qrand() % (1000 * 10));
+    scheduler->setPhase(jobName("getUserDataUpdate"),
+                        qrand() % (1000 * qMax(syncInterval, 1)));
+  } else {
+    resumeSession();
+
+    checkForInternetConnectivity();
+    scheduler->start("checkForInternetConnectivity");
+  }
+
+  registerNode();
+  scheduler->start(jobName("registerNode"));
+
+  qDebug("LEAVE NetworkClient::start");
+}
+
+/* Sends a GET request on the shared manager, the reply is passed to the
+ * named slot once it has finished */
+QNetworkReply *NetworkClient::sendRequest(const QUrl &url,
+                                          const char *handler) {
+  QNetworkReply *reply = nam->get(serverRequest(url));
+  reply->setProperty("handler", handler);
+  return reply;
+}
+
+/* Requests to the Libki server offer the saved TLS session, other hosts
+ * (the internet connectivity checks) get a plain request */
+QNetworkRequest NetworkClient::serverRequest(const QUrl &url) {
+  QNetworkRequest request(url);
+  if (tlsSessionCache && url.scheme() == "https" &&
+      url.host() == serviceURL.host()) {
+    request.setSslConfiguration(tlsSessionCache->configuration());
+  }
+  request.setAttribute(QNetworkRequest::User, requestClock.nsecsElapsed());
+  return request;
+}
+
+/* Requests are counted per API action, requests to other hosts are the
+ * internet connectivity checks */
+QString NetworkClient::replyAction(QNetworkReply *reply) const {
+  if (reply->url().host() != serviceURL.host()) return "internet_check";
+
+  QString action = QUrlQuery(reply->url()).queryItemValue("action");
+  if (action.isEmpty()) action = reply->url().path().section('/', -1);
+  return action;
+}
+
+void NetworkClient::recordReplyMetrics(QNetworkReply *reply) {
+  QString action = replyAction(reply);
+  QString labels = QString("action=\"%1\"").arg(action);
+
+  Metrics::incrementCounter("libki_requests_total", labels);
+  if (reply->error() != QNetworkReply::NoError) {
+    Metrics::incrementCounter("libki_request_errors_total", labels);
+  }
+
+  QVariant sent = reply->request().attribute(QNetworkRequest::User);
+  if (sent.isValid()) {
+    qint64 nsecs = requestClock.nsecsElapsed() - sent.toLongLong();
+    Metrics::observe("libki_request_duration_seconds", labels, nsecs / 1e9);
+
+    emit requestFinished(action, nsecs,
+                         reply->error() == QNetworkReply::NoError);
+  }
+
+  // Uploads report their size, other requests are GETs
+  QVariant bytesSent = reply->property("bytesSent");
+  Metrics::incrementCounter(
+      "libki_sent_bytes_total", labels,
+      bytesSent.isValid() ? bytesSent.toLongLong()
+                          : reply->url().toEncoded().size());
+  Metrics::incrementCounter("libki_received_bytes_total", labels,
+                            reply->bytesAvailable());
+}
+
+void NetworkClient::handleEncrypted(QNetworkReply *reply) {
+  QVariant sent = reply->request().attribute(QNetworkRequest::User);
+  if (!sent.isValid() || !tlsSessionCache) return;
+
+  // Includes the name lookup and TCP connect, both don't change with resumption
+  qint64 nsecs = requestClock.nsecsElapsed() - sent.toLongLong();
+  PerfUtils::recordDuration(
+      QString("TLS handshake to %1 (%2)")
+          .arg(reply->url().host())
+          .arg(tlsSessionCache->hasTicket() ? "ticket offered" : "full"),
+      nsecs);
+}
+
+void NetworkClient::dispatchReply(QNetworkReply *reply) {
+  if (tlsSessionCache && reply->url().scheme() == "https" &&
+      reply->url().host() == serviceURL.host()) {
+    tlsSessionCache->update(reply);
+  }
+
+  recordReplyMetrics(reply);
+
+  QVariant sent = reply->request().attribute(QNetworkRequest::User);
+  if (trafficCapture && sent.isValid()) {
+    qint64 sentMsecs = sent.toLongLong() / 1000000;
+    trafficCapture->record(reply, replyAction(reply), sentMsecs,
+                           requestClock.elapsed() - sentMsecs);
+  }
+
+  QByteArray handler = reply->property("handler").toByteArray();
+  if (handler.isEmpty()) {
+    reply->deleteLater();
+    return;
+  }
+
+  QMetaObject::invokeMethod(this, handler.constData(), Qt::DirectConnection,
+                            Q_ARG(QNetworkReply *, reply));
+}
+
+/* Called between sessions, the next login or warm up connects again */
+void NetworkClient::releaseIdleConnections() {
+  qDebug("ENTER NetworkClient::releaseIdleConnections");
+
+  if (nam) nam->clearAccessCache();
+
+  qDebug("LEAVE NetworkClient::releaseIdleConnections");
+}
+
+/* Called while a patron starts typing on the login screen. Opening the
+ * connection now hides the connection setup behind the typing, the periodic
+ * requests keep it open afterwards. */
+void NetworkClient::warmUpConnection() {
+  if (!tlsSessionCache) return;
+
+  if (lastWarmUp.isValid() && lastWarmUp.elapsed() < 1000 * WARM_UP_INTERVAL) {
+    return;
+  }
+
+  qDebug("ENTER NetworkClient::warmUpConnection");
+
+  PerfUtils::ScopedTimer perfTimer("NetworkClient::warmUpConnection");
+  lastWarmUp.start();
+
+  int port = serviceURL.port();
+#ifndef QT_NO_SSL
+  if (serviceURL.scheme() == "https") {
+    nam->connectToHostEncrypted(serviceURL.host(), port > 0 ? port : 443,
+                                tlsSessionCache->configuration());
+  } else {
+    nam->connectToHost(serviceURL.host(), port > 0 ? port : 80);
+  }
+#else
+  nam->connectToHost(serviceURL.host(), port > 0 ? port : 80);
+#endif  // ifndef QT_NO_SSL
+
+  qDebug("LEAVE NetworkClient::warmUpConnection");
 }
 
 void NetworkClient::attemptLogin(QString aUsername, QString aPassword) {
@@ -122,15 +473,7 @@ void NetworkClient::attemptLogin(QString aUsername, QString aPassword) {
   qDebug() << "LOGIN URL: " << url.toString();
   qDebug() << "NetworkClient::attemptLogin";
 
-  QNetworkAccessManager *nam;
-  nam = new QNetworkAccessManager(this);
-  QObject::connect(nam, SIGNAL(finished(QNetworkReply *)), this,
-                   SLOT(processAttemptLoginReply(QNetworkReply *)));
-  QObject::connect(
-      nam, SIGNAL(sslErrors(QNetworkReply *, const QList<QSslError> &)), this,
-      SLOT(handleSslErrors(QNetworkReply *, const QList<QSslError> &)));
-
-  /*QNetworkReply* reply = */ nam->get(QNetworkRequest(url));
+  sendRequest(url, "processAttemptLoginReply");
   qDebug("LEAVE NetworkClient::attemptLogin");
 }
 
@@ -152,6 +495,9 @@ void NetworkClient::processAttemptLoginReply(QNetworkReply *reply) {
     int units = sc.property("units").toInteger();
     int hold_items_count = sc.property("hold_items_count").toInteger();
 
+    QScriptValue token = sc.property("session_token");
+    sessionToken = token.isString() ? token.toString() : QString();
+
     doLoginTasks(units, hold_items_count);
   } else {
     qDebug("Login Failed");
@@ -167,7 +513,6 @@ void NetworkClient::processAttemptLoginReply(QNetworkReply *reply) {
 
   reply->abort();
   reply->deleteLater();
-  reply->manager()->deleteLater();
 
   qDebug("LEAVE NetworkClient::processAttemptLogoutReply");
 }
@@ -175,23 +520,18 @@ void NetworkClient::processAttemptLoginReply(QNetworkReply *reply) {
 void NetworkClient::attemptLogout() {
   qDebug("ENTER NetworkClient::attemptLogout");
 
-  QNetworkAccessManager *nam;
-  nam = new QNetworkAccessManager(this);
-  QObject::connect(nam, SIGNAL(finished(QNetworkReply *)), this,
-                   SLOT(processAttemptLogoutReply(QNetworkReply *)));
-  QObject::connect(
-      nam, SIGNAL(sslErrors(QNetworkReply *, const QList<QSslError> &)), this,
-      SLOT(handleSslErrors(QNetworkReply *, const QList<QSslError> &)));
-
   QUrl url = QUrl(serviceURL);
   QUrlQuery query = QUrlQuery(urlQuery);
   query.addQueryItem("version", VERSION);
   query.addQueryItem("action", "logout");
   query.addQueryItem("username", username);
   query.addQueryItem("password", password);
+  if (!sessionToken.isEmpty()) {
+    query.addQueryItem("session_token", sessionToken);
+  }
   url.setQuery(query);
 
-  /*QNetworkReply* reply =*/nam->get(QNetworkRequest(url));
+  sendRequest(url, "processAttemptLogoutReply");
 
   qDebug("LEAVE NetworkClient::attemptLogout");
 }
@@ -216,7 +556,6 @@ void NetworkClient::processAttemptLogoutReply(QNetworkReply *reply) {
 
   reply->abort();
   reply->deleteLater();
-  reply->manager()->deleteLater();
 
   qDebug("LEAVE NetworkClient::processAttemptLogoutReply");
 }
@@ -224,22 +563,18 @@ void NetworkClient::processAttemptLogoutReply(QNetworkReply *reply) {
 void NetworkClient::getUserDataUpdate() {
   qDebug("ENTER NetworkClient::getUserDataUpdate");
 
-  QNetworkAccessManager *nam = new QNetworkAccessManager(this);
-  QObject::connect(nam, SIGNAL(finished(QNetworkReply *)), this,
-                   SLOT(processGetUserDataUpdateReply(QNetworkReply *)));
-  QObject::connect(
-      nam, SIGNAL(sslErrors(QNetworkReply *, const QList<QSslError> &)), this,
-      SLOT(handleSslErrors(QNetworkReply *, const QList<QSslError> &)));
-
   QUrl url = QUrl(serviceURL);
   QUrlQuery query = QUrlQuery(urlQuery);
   query.addQueryItem("version", VERSION);
   query.addQueryItem("action", "get_user_data");
   query.addQueryItem("username", username);
   query.addQueryItem("password", password);
+  if (!sessionToken.isEmpty()) {
+    query.addQueryItem("session_token", sessionToken);
+  }
   url.setQuery(query);
 
-  /*QNetworkReply* reply =*/nam->get(QNetworkRequest(url));
+  sendRequest(url, "processGetUserDataUpdateReply");
 
   qDebug("LEAVE NetworkClient::getUserDataUpdate");
 }
@@ -281,6 +616,11 @@ void NetworkClient::processGetUserDataUpdateReply(QNetworkReply *reply) {
 
       emit timeUpdatedFromServer(units);
 
+      if (sessionCheckpoint.isValid()) {
+        sessionCheckpoint.secondsRemaining = qint64(units) * 60;
+        sessionCheckpoint.save();
+      }
+
       if (units < 1) {
         doLogoutTasks();
       }
@@ -293,11 +633,126 @@ void NetworkClient::processGetUserDataUpdateReply(QNetworkReply *reply) {
 
   reply->abort();
   reply->deleteLater();
-  reply->manager()->deleteLater();
 
   qDebug("LEAVE NetworkClient::processGetUserDataUpdateReply");
 }
 
+/* Picks up the session a crashed or killed client left behind, if the
+ * server still considers the patron logged in. Nothing is run on failure,
+ * the patron never logged out from the server's point of view. */
+void NetworkClient::resumeSession() {
+  qDebug("ENTER NetworkClient::resumeSession");
+
+  // A patron logged in while we were waiting for the server
+  if (!username.isEmpty()) {
+    qDebug("LEAVE NetworkClient::resumeSession");
+    return;
+  }
+
+  SessionCheckpoint checkpoint = SessionCheckpoint::load();
+  if (!checkpoint.isValid()) {
+    qDebug("LEAVE NetworkClient::resumeSession");
+    return;
+  }
+
+  if (checkpoint.isExpired() || !checkpoint.canResume()) {
+    qDebug() << "Session checkpoint for " << checkpoint.username
+             << " has expired or can't be resumed";
+    SessionCheckpoint::clear();
+    qDebug("LEAVE NetworkClient::resumeSession");
+    return;
+  }
+
+  qDebug() << "RESUMING SESSION: " << checkpoint.username;
+
+  sessionCheckpoint = checkpoint;
+  username = checkpoint.username;
+  password = checkpoint.password;
+  sessionToken = checkpoint.token;
+
+  QUrl url = QUrl(serviceURL);
+  QUrlQuery query = QUrlQuery(urlQuery);
+  query.addQueryItem("version", VERSION);
+  query.addQueryItem("action", "get_user_data");
+  query.addQueryItem("username", username);
+  query.addQueryItem("password", password);
+  if (!sessionToken.isEmpty()) {
+    query.addQueryItem("session_token", sessionToken);
+  }
+  url.setQuery(query);
+
+  sendRequest(url, "processResumeSessionReply");
+
+  qDebug("LEAVE NetworkClient::resumeSession");
+}
+
+void NetworkClient::processResumeSessionReply(QNetworkReply *reply) {
+  qDebug("ENTER NetworkClient::processResumeSessionReply");
+
+  handleNetworkReplyErrors(reply);
+
+  if (reply->error() != QNetworkReply::NoError) {
+    // Keep the checkpoint, the server may just not be reachable yet
+    username.clear();
+    password.clear();
+    sessionToken.clear();
+    sessionCheckpoint = SessionCheckpoint();
+    Scheduler::instance()->startOnce(jobName("resumeSession"), 1000 * 10);
+  } else {
+    QJsonDocument jd = QJsonDocument::fromJson(reply->readAll());
+    QJsonObject jo = jd.object();
+
+    QString status = jo["status"].toString();
+    int units = jo["units"].toVariant().toInt();
+    qDebug() << "RESUME STATUS: " << status << " UNITS: " << units;
+
+    if (status == "Logged in" && units > 0 && sessionCheckpoint.locked &&
+        password.isEmpty() && passwordsRequired()) {
+      // The lock screen can't check the patron without the password, the
+      // session is ended rather than left open to anyone at the kiosk
+      qDebug() << "Logging out the locked session of " << username;
+      SessionCheckpoint::clear();
+      sessionCheckpoint = SessionCheckpoint();
+      attemptLogout();
+
+      username.clear();
+      sessionToken.clear();
+    } else if (status == "Logged in" && units > 0) {
+      bool locked = sessionCheckpoint.locked;
+
+      // Saved again by the login tasks, with a password only if allowed
+      SessionCheckpoint::clear();
+      doLoginTasks(units, 0);
+
+      if (locked) {
+        emit sessionLockRestored();
+      }
+    } else {
+      username.clear();
+      password.clear();
+      sessionToken.clear();
+      sessionCheckpoint = SessionCheckpoint();
+      SessionCheckpoint::clear();
+    }
+  }
+
+  reply->abort();
+  reply->deleteLater();
+
+  qDebug("LEAVE NetworkClient::processResumeSessionReply");
+}
+
+void NetworkClient::setSessionLocked(bool locked) {
+  qDebug("ENTER NetworkClient::setSessionLocked");
+
+  if (sessionCheckpoint.isValid() && sessionCheckpoint.locked != locked) {
+    sessionCheckpoint.locked = locked;
+    sessionCheckpoint.save();
+  }
+
+  qDebug("LEAVE NetworkClient::setSessionLocked");
+}
+
 void NetworkClient::uploadPrintJobs() {
   qDebug() << "NetworkClient::uploadPrintJobs";
 
@@ -353,81 +808,89 @@ void NetworkClient::uploadPrintJobs() {
       bool opened = file->open(QIODevice::ReadOnly);
       if ( !opened ) {
           qDebug() << "OPENDING FILE " << newAbsoluteFilePath << " FAILED! SKIPPING FILE.";
+          delete file;
           continue;
       }
 
-      QHttpMultiPart *multiPart =
-          new QHttpMultiPart(QHttpMultiPart::FormDataType);
-
-      // We con't delete the file object now, delete it with the multiPart
-      file->setParent(multiPart);
-
-      QHttpPart clientNamePart;
-      clientNamePart.setHeader(QNetworkRequest::ContentDispositionHeader,
-                               QVariant("form-data; name=client_name"));
-      QByteArray clientNameQBA;
-      clientNameQBA.append(nodeName);
-      clientNamePart.setBody(clientNameQBA);
-      multiPart->append(clientNamePart);
-
-      QHttpPart userNamePart;
-      userNamePart.setHeader(QNetworkRequest::ContentDispositionHeader,
-                             QVariant("form-data; name=username"));
-      QByteArray userNameQBA;
-      userNameQBA.append(username);
-      userNamePart.setBody(userNameQBA);
-      multiPart->append(userNamePart);
-
-      QHttpPart printerNamePart;
-      printerNamePart.setHeader(QNetworkRequest::ContentDispositionHeader,
-                                QVariant("form-data; name=printer"));
-      QByteArray printerNameQBA;
-      printerNameQBA.append(printer);
-      printerNamePart.setBody(printerNameQBA);
-      multiPart->append(printerNamePart);
-
-      QHttpPart printJobPart;
-      printJobPart.setHeader(
-          QNetworkRequest::ContentDispositionHeader,
-          QVariant("form-data; name=print_file; filename=" + fileName));
-      printJobPart.setBodyDevice(file);
-      multiPart->append(printJobPart);
-
-      QHttpPart fileNamePart;
-      fileNamePart.setHeader(QNetworkRequest::ContentDispositionHeader,
-                             QVariant("form-data; name=filename"));
-      QByteArray fileNameQBA;
-      fileNameQBA.append(fileName);
-      fileNamePart.setBody(fileNameQBA);
-      multiPart->append(fileNamePart);
-
-      QUrl printUrl = QUrl(serviceURL);
-      printUrl.setPath("/api/client/v1_0/print");
-      QNetworkRequest request(printUrl);
-
-      QNetworkAccessManager *networkManager = new QNetworkAccessManager(this);
-      QObject::connect(
-          networkManager,
-          SIGNAL(sslErrors(QNetworkReply *, const QList<QSslError> &)), this,
-          SLOT(handleSslErrors(QNetworkReply *, const QList<QSslError> &)));
-
-      QNetworkReply *reply = networkManager->post(request, multiPart);
-      multiPart->setParent(reply);  // delete the multiPart with the reply
-
-      // TODO: delete file after finished signal emits
-      // https://stackoverflow.com/questions/5153157/passing-an-argument-to-a-slot
-      connect(networkManager, SIGNAL(finished(QNetworkReply *)), this,
-              SLOT(uploadPrintJobReply(QNetworkReply *)));
-      connect(reply, SIGNAL(uploadProgress(qint64, qint64)), this,
-              SLOT(handleUploadProgress(qint64, qint64)));
+      sendPrintJob(printer, fileName, file);
     }
   }
 
   qDebug() << "LEAVE NetworkClient::uploadPrintJobs";
 }
 
+/* Uploads one print job, the data is deleted once the upload is done */
+void NetworkClient::sendPrintJob(const QString &printer,
+                                 const QString &fileName, QIODevice *data) {
+  QHttpMultiPart *multiPart =
+      new QHttpMultiPart(QHttpMultiPart::FormDataType);
+
+  // We con't delete the file object now, delete it with the multiPart
+  data->setParent(multiPart);
+
+  QHttpPart clientNamePart;
+  clientNamePart.setHeader(QNetworkRequest::ContentDispositionHeader,
+                           QVariant("form-data; name=client_name"));
+  QByteArray clientNameQBA;
+  clientNameQBA.append(nodeName);
+  clientNamePart.setBody(clientNameQBA);
+  multiPart->append(clientNamePart);
+
+  QHttpPart userNamePart;
+  userNamePart.setHeader(QNetworkRequest::ContentDispositionHeader,
+                         QVariant("form-data; name=username"));
+  QByteArray userNameQBA;
+  userNameQBA.append(username);
+  userNamePart.setBody(userNameQBA);
+  multiPart->append(userNamePart);
+
+  QHttpPart printerNamePart;
+  printerNamePart.setHeader(QNetworkRequest::ContentDispositionHeader,
+                            QVariant("form-data; name=printer"));
+  QByteArray printerNameQBA;
+  printerNameQBA.append(printer);
+  printerNamePart.setBody(printerNameQBA);
+  multiPart->append(printerNamePart);
+
+  QHttpPart printJobPart;
+  printJobPart.setHeader(
+      QNetworkRequest::ContentDispositionHeader,
+      QVariant("form-data; name=print_file; filename=" + fileName));
+  printJobPart.setBodyDevice(data);
+  multiPart->append(printJobPart);
+
+  QHttpPart fileNamePart;
+  fileNamePart.setHeader(QNetworkRequest::ContentDispositionHeader,
+                         QVariant("form-data; name=filename"));
+  QByteArray fileNameQBA;
+  fileNameQBA.append(fileName);
+  fileNamePart.setBody(fileNameQBA);
+  multiPart->append(fileNamePart);
+
+  QUrl printUrl = QUrl(serviceURL);
+  printUrl.setPath("/api/client/v1_0/print");
+  QNetworkRequest request = serverRequest(printUrl);
+
+  QNetworkReply *reply = nam->post(request, multiPart);
+  reply->setProperty("handler", "uploadPrintJobReply");
+  multiPart->setParent(reply);  // delete the multiPart with the reply
+
+  printJobsInFlight++;
+  Metrics::setGauge("libki_print_queue_depth", QString(),
+                    printJobsInFlight);
+
+  // TODO: delete file after finished signal emits
+  // https://stackoverflow.com/questions/5153157/passing-an-argument-to-a-slot
+  connect(reply, SIGNAL(uploadProgress(qint64, qint64)), this,
+          SLOT(handleUploadProgress(qint64, qint64)));
+}
+
 void NetworkClient::handleUploadProgress(qint64 bytesSent, qint64 bytesTotal) {
   qDebug() << "Uploaded " << bytesSent << "of" << bytesTotal;
+
+  if (sender()) {
+    sender()->setProperty("bytesSent", bytesSent);
+  }
 }
 
 void NetworkClient::uploadPrintJobReply(QNetworkReply *reply) {
@@ -436,49 +899,74 @@ void NetworkClient::uploadPrintJobReply(QNetworkReply *reply) {
   handleNetworkReplyErrors(reply);
 
   if (reply->error() == QNetworkReply::NoError) {
+    printJobsInFlight--;
+    Metrics::setGauge("libki_print_queue_depth", QString(),
+                      printJobsInFlight);
+
     reply->abort();
     reply->deleteLater();
-    reply->manager()->deleteLater();
   } else {
     qDebug() << "Network Error: " << reply->errorString();
-    qDebug() << "Retrying network request.";
 
-    QNetworkRequest request = reply->request();
+    // Retrying at once flooded a server that was down with uploads, the
+    // wait doubles with each attempt and is spread over the fleet
+    int attempts = reply->property("attempts").toInt() + 1;
+    int delay =
+        qMin(PRINT_RETRY_MIN << qMin(attempts - 1, 6), PRINT_RETRY_MAX);
+    delay += qrand() % (delay / 4 + 1);
+    qDebug() << "Retrying print job in " << delay << " ms";
+
+    // The failed reply holds the request and the multiPart until then
+    reply->setProperty("attempts", attempts);
+    reply->setProperty("retryAt", requestClock.elapsed() + delay);
+    printJobRetries << reply;
+    retryPrintJobs();
+  }
 
-    QHttpMultiPart *multiPart = reply->findChild<QHttpMultiPart *>();
-    qDebug() << "Found multiPart " << multiPart;
+  qDebug("LEAVE NetworkClient::uploadPrintJobReply");
+}
+
+/* Posts the print jobs whose retry is due again, then waits for the next */
+void NetworkClient::retryPrintJobs() {
+  qDebug("ENTER NetworkClient::retryPrintJobs");
+
+  qint64 now = requestClock.elapsed();
+  qint64 next = -1;
+
+  foreach (QNetworkReply *failed, printJobRetries) {
+    qint64 due = failed->property("retryAt").toLongLong();
+    if (due > now) {
+      next = next < 0 ? due : qMin(next, due);
+      continue;
+    }
+    printJobRetries.removeOne(failed);
 
-    QNetworkAccessManager *networkManager = new QNetworkAccessManager(this);
-    QObject::connect(
-        networkManager,
-        SIGNAL(sslErrors(QNetworkReply *, const QList<QSslError> &)), this,
-        SLOT(handleSslErrors(QNetworkReply *, const QList<QSslError> &)));
+    QNetworkRequest request = failed->request();
+    request.setAttribute(QNetworkRequest::User, requestClock.nsecsElapsed());
 
-    QNetworkReply *reply = networkManager->post(request, multiPart);
+    QHttpMultiPart *multiPart = failed->findChild<QHttpMultiPart *>();
+    QNetworkReply *reply = nam->post(request, multiPart);
+    reply->setProperty("handler", "uploadPrintJobReply");
+    reply->setProperty("attempts", failed->property("attempts"));
 
     multiPart->setParent(reply);  // delete the multiPart with the reply
+    failed->deleteLater();
 
-    connect(networkManager, SIGNAL(finished(QNetworkReply *)), this,
-            SLOT(uploadPrintJobReply(QNetworkReply *)));
     connect(reply, SIGNAL(uploadProgress(qint64, qint64)), this,
             SLOT(handleUploadProgress(qint64, qint64)));
-  };
+  }
 
-  qDebug("LEAVE NetworkClient::uploadPrintJobReply");
+  if (next >= 0) {
+    Scheduler::instance()->startOnce(jobName("retryPrintJobs"),
+                                     int(next - now));
+  }
+
+  qDebug("LEAVE NetworkClient::retryPrintJobs");
 }
 
 void NetworkClient::registerNode() {
   qDebug("ENTER NetworkClient::registerNode");
 
-  QNetworkAccessManager *nam;
-  nam = new QNetworkAccessManager(this);
-  QObject::connect(nam, SIGNAL(finished(QNetworkReply *)), this,
-                   SLOT(processRegisterNodeReply(QNetworkReply *)));
-
-  QObject::connect(nam, SIGNAL(sslErrors(QNetworkReply *, QList<QSslError>)),
-                   this,
-                   SLOT(handleSslErrors(QNetworkReply *, QList<QSslError>)));
-
   QUrl url = QUrl(serviceURL);
   QUrlQuery query = QUrlQuery(urlQuery);
   query.addQueryItem("version", VERSION);
@@ -487,14 +975,27 @@ void NetworkClient::registerNode() {
   query.addQueryItem("age_limit", nodeAgeLimit);
   url.setQuery(query);
 
-  /*QNetworkReply* reply =*/nam->get(QNetworkRequest(url));
+  sendRequest(url, "processRegisterNodeReply");
 
   qDebug("LEAVE NetworkClient::registerNode");
 }
 
+/* Certificate errors on the Libki server are only ignored for the pinned
+ * certificate, see TlsSessionCache. The connectivity checks only need to
+ * know whether a host answers. */
 void NetworkClient::handleSslErrors(QNetworkReply *reply,
                                     QList<QSslError> error) {
-  reply->ignoreSslErrors(error);
+  if (reply->url().host() != serviceURL.host() ||
+      (tlsSessionCache && tlsSessionCache->acceptErrors(reply, error))) {
+    reply->ignoreSslErrors(error);
+  } else {
+    // Shown on the login screen, staff need the fingerprint to update the
+    // setting after the server's certificate was renewed
+    reply->setProperty(
+        "unpinnedCertificate",
+        TlsSessionCache::fingerprint(
+            reply->sslConfiguration().peerCertificate()));
+  }
 }
 
 void NetworkClient::processRegisterNodeReply(QNetworkReply *reply) {
@@ -513,6 +1014,8 @@ void NetworkClient::processRegisterNodeReply(QNetworkReply *reply) {
 
   if (!sc.property("registered").toBoolean()) {
     qDebug("Node Registration FAILED");
+  } else if (!simulated) {
+    StartupProfile::milestone("first registration");
   }
 
   // TODO: Rename this to something like 'auto-login guest session'
@@ -523,6 +1026,35 @@ void NetworkClient::processRegisterNodeReply(QNetworkReply *reply) {
     doLoginTasks(sc.property("minutes").toInteger(), 0);
   }
 
+  // Simulated nodes must not act on commands meant for this machine, nor
+  // overwrite its settings
+  if (!simulated) {
+    runServerCommands(sc);
+    applyServerSettings(sc);
+  }
+
+  QString reserved_for = sc.property("reserved_for").toString();
+  emit setReservationStatus(reserved_for);
+
+  QString status = sc.property("status").toString();
+  if (status != clientStatus) {
+    if (status == "suspended") {
+      emit clientSuspended();
+    } else if (status == "online") {
+      emit clientOnline();
+    }
+  }
+  clientStatus = status;
+
+  reply->abort();
+  reply->deleteLater();
+
+  qDebug("LEAVE NetworkClient::processRegisterNodeReply");
+}
+
+/* Shutdown, suspend, restart and wake up requests sent with the
+ * registration reply */
+void NetworkClient::runServerCommands(const QScriptValue &sc) {
   if (sc.property("shutdown").toBoolean()) {
     qDebug("Received shutdown message from server");
 
@@ -568,13 +1100,25 @@ void NetworkClient::processRegisterNodeReply(QNetworkReply *reply) {
   if (sc.property("wakeup").toBoolean()) {
     QStringList MAC_addresses = sc.engine()->fromScriptValue<QStringList>(
         sc.property("wol_mac_addresses"));
-    wakeOnLan(MAC_addresses, sc.property("wol_host").toString(),
-              sc.property("wol_port").toInteger());
+    wakeOnLan->wake(MAC_addresses, sc.property("wol_host").toString(),
+                    quint16(sc.property("wol_port").toInteger()));
   }
+}
 
-  QString styleSheet = sc.property("ClientStyleSheet").toString();
+/* Stores the server's settings for the windows, they are told about new
+ * banners and stylesheets */
+void NetworkClient::applyServerSettings(const QScriptValue &sc) {
+  QScriptValue styleSheetValue = sc.property("ClientStyleSheet");
+  QString styleSheet =
+      styleSheetValue.isNull() ? QString() : styleSheetValue.toString();
   if (!styleSheet.isEmpty()) {
-      this->app->setStyleSheet(styleSheet);
+      applyStyleSheet(styleSheet);
+  } else if (styleSheetValue.isValid() && !styleSheetValue.isUndefined() &&
+             !styleSheetHash.isEmpty()) {
+    // The server dropped its stylesheet, the next start must not bring back
+    // the cached one. The running windows keep theirs until then.
+    styleSheetHash.clear();
+    clearCachedStyleSheet();
   }
 
   QSettings settings;
@@ -652,25 +1196,26 @@ void NetworkClient::processRegisterNodeReply(QNetworkReply *reply) {
   ) {
     emit handleBanners();  // TODO: Emit only if a banner url has changed
   }
+}
 
-  QString reserved_for = sc.property("reserved_for").toString();
-  emit setReservationStatus(reserved_for);
-
-  QString status = sc.property("status").toString();
-  if (status != clientStatus) {
-    if (status == "suspended") {
-      emit clientSuspended();
-    } else if (status == "online") {
-      emit clientOnline();
-    }
+/* Setting the application stylesheet re-polishes every widget, so only ask
+ * the GUI thread to do it when the server sends a different one. The last one
+ * is kept on disk and applied at startup. */
+void NetworkClient::applyStyleSheet(const QString &styleSheet) {
+  QByteArray hash =
+      QCryptographicHash::hash(styleSheet.toUtf8(), QCryptographicHash::Sha1);
+  if (hash == styleSheetHash) {
+    return;
   }
-  clientStatus = status;
 
-  reply->abort();
-  reply->deleteLater();
-  reply->manager()->deleteLater();
+  qDebug("ENTER NetworkClient::applyStyleSheet");
 
-  qDebug("LEAVE NetworkClient::processRegisterNodeReply");
+  styleSheetHash = hash;
+  setCachedStyleSheet(styleSheet);
+
+  emit styleSheetChanged(styleSheet);
+
+  qDebug("LEAVE NetworkClient::applyStyleSheet");
 }
 
 void NetworkClient::checkForInternetConnectivity() {
@@ -693,15 +1238,7 @@ void NetworkClient::checkForInternetConnectivity() {
 
       qDebug() << "CHECKING URL: " << url;
 
-      QNetworkAccessManager *nam;
-      nam = new QNetworkAccessManager(this);
-      QObject::connect(nam, SIGNAL(finished(QNetworkReply *)), this,
-               SLOT(processCheckForInternetConnectivityReply(QNetworkReply *)));
-      QObject::connect(
-          nam, SIGNAL(sslErrors(QNetworkReply *, const QList<QSslError> &)), this,
-          SLOT(handleSslErrors(QNetworkReply *, const QList<QSslError> &)));
-
-      nam->get(QNetworkRequest(QUrl(url)));
+      sendRequest(QUrl(url), "processCheckForInternetConnectivityReply");
   }
 
   qDebug("LEAVE NetworkClient::checkForInternetConnectivity");
@@ -719,7 +1256,6 @@ void NetworkClient::processCheckForInternetConnectivityReply(QNetworkReply *repl
 
   reply->abort();
   reply->deleteLater();
-  reply->manager()->deleteLater();
 
   qDebug("LEAVE NetworkClient::processCheckForInternetConnectivityReply");
 }
@@ -727,12 +1263,6 @@ void NetworkClient::processCheckForInternetConnectivityReply(QNetworkReply *repl
 void NetworkClient::clearMessage() {
   qDebug("ENTER NetworkClient::clearMessage");
 
-  QNetworkAccessManager *nam = new QNetworkAccessManager(this);
-  QObject::connect(nam, SIGNAL(finished(QNetworkReply *)), this,
-                   SLOT(ignoreNetworkReply(QNetworkReply *)));
-  QObject::connect(
-      nam, SIGNAL(sslErrors(QNetworkReply *, const QList<QSslError> &)), this,
-      SLOT(handleSslErrors(QNetworkReply *, const QList<QSslError> &)));
   QUrl url = QUrl(serviceURL);
   QUrlQuery query = QUrlQuery(urlQuery);
   query.addQueryItem("version", VERSION);
@@ -740,7 +1270,7 @@ void NetworkClient::clearMessage() {
   query.addQueryItem("username", username);
   query.addQueryItem("password", password);
   url.setQuery(query);
-  nam->get(QNetworkRequest(url));
+  sendRequest(url, "ignoreNetworkReply");
 
   qDebug("LEAVE NetworkClient::clearMessage");
 }
@@ -748,12 +1278,6 @@ void NetworkClient::clearMessage() {
 void NetworkClient::acknowledgeReservation(QString reserved_for) {
   qDebug("ENTER NetworkClient::acknowledgeReservation");
 
-  QNetworkAccessManager *nam = new QNetworkAccessManager(this);
-  QObject::connect(nam, SIGNAL(finished(QNetworkReply *)), this,
-                   SLOT(ignoreNetworkReply(QNetworkReply *)));
-  QObject::connect(
-      nam, SIGNAL(sslErrors(QNetworkReply *, const QList<QSslError> &)), this,
-      SLOT(handleSslErrors(QNetworkReply *, const QList<QSslError> &)));
   QUrl url = QUrl(serviceURL);
   QUrlQuery query = QUrlQuery(urlQuery);
   query.addQueryItem("version", VERSION);
@@ -761,7 +1285,7 @@ void NetworkClient::acknowledgeReservation(QString reserved_for) {
   query.addQueryItem("reserved_for", reserved_for);
   url.setQuery(query);
 
-  nam->get(QNetworkRequest(url));
+  sendRequest(url, "ignoreNetworkReply");
 
   qDebug("LEAVE NetworkClient::acknowledgeReservation");
 }
@@ -773,7 +1297,6 @@ void NetworkClient::ignoreNetworkReply(QNetworkReply *reply) {
 
   reply->abort();
   reply->deleteLater();
-  reply->manager()->deleteLater();
 
   qDebug("LEAVE NetworkClient::ignoreNetworkReply");
 }
@@ -781,26 +1304,49 @@ void NetworkClient::ignoreNetworkReply(QNetworkReply *reply) {
 void NetworkClient::doLoginTasks(int units, int hold_items_count) {
   qDebug("ENTER NetworkClient::doLoginTasks");
 
+  if (simulated) {
+    if (!replaying) Scheduler::instance()->start(jobName("getUserDataUpdate"));
+    emit loginSucceeded(username, password, units, hold_items_count);
+    qDebug("LEAVE NetworkClient::doLoginTasks");
+    return;
+  }
+
+  // The previous patron's print jobs and hooks go before this one's start
+  finishLogout();
+
 #ifdef Q_OS_WIN
   // FIXME: We should delete print jobs at login as well in case a client crash
   // prevented the print jobs for getting cleaned up at logout time
 
   // If this is an MS Windows platform, use the keylocker programs to limit
   // mischief.
-  QProcess::startDetached("c:/windows/explorer.exe");
-  QProcess::startDetached("windows/on_login.exe");
+  ProcessSupervisor *supervisor = ProcessSupervisor::instance();
+  supervisor->detach("explorer", "c:/windows/explorer.exe");
+  supervisor->run("on_login", "windows/on_login.exe");
 #endif  // ifdef Q_OS_WIN
 
-  uploadPrintJobsTimer->start(1000 * 2);
-  updateUserDataTimer->start(1000 * 10);
+  Scheduler::instance()->start("uploadPrintJobs");
+  Scheduler::instance()->start("getUserDataUpdate");
 
   QSettings settings;
   settings.setIniCodec("UTF-8");
   settings.setValue("session/LoggedInUser", username);
   settings.sync();
+
+  sessionCheckpoint.username = username;
+  sessionCheckpoint.token = sessionToken;
+  // Without a token only a kiosk that allows it keeps the password on disk
+  sessionCheckpoint.password =
+      sessionToken.isEmpty() &&
+              settings.value("node/checkpoint_password").toBool()
+          ? password
+          : QString();
+  sessionCheckpoint.secondsRemaining = qint64(units) * 60;
+  sessionCheckpoint.save();
   qDebug() << "SCRIPTLOGIN:" << settings.value("scriptlogin/enable").toString();
   if (settings.value("scriptlogin/enable").toString() == "1") {
-    QProcess::startDetached(settings.value("scriptlogin/script").toString());
+    ProcessSupervisor::instance()->run(
+        "scriptlogin", settings.value("scriptlogin/script").toString());
   }
   emit loginSucceeded(username, password, units, hold_items_count);
 
@@ -810,118 +1356,134 @@ void NetworkClient::doLoginTasks(int units, int hold_items_count) {
 void NetworkClient::doLogoutTasks() {
   qDebug("ENTER NetworkClient::doLogoutTasks");
 
-  QSettings settings;
-  settings.setIniCodec("UTF-8");
-  settings.setValue("session/LoggedInUser", "");
-  settings.sync();
-
-  // Delete print jobs
-  QSettings printerSettings;
-  printerSettings.beginGroup("printers");
-  QStringList printers = printerSettings.allKeys();
-  foreach (const QString &printer, printers) {
-    QString directory = printerSettings.value(printer).toString();
-    QDir dir(directory);
-
-    dir.setFilter(QDir::Files);
-
-    QFileInfoList list = dir.entryInfoList();
-
-    for (int i = 0; i < list.size(); ++i) {
-      QFileInfo fileInfo = list.at(i);
-      QString absoluteFilePath = fileInfo.absoluteFilePath();
-      QFile::remove(absoluteFilePath);
-    }
+  if (simulated) {
+    Scheduler::instance()->stop(jobName("getUserDataUpdate"));
+    username.clear();
+    password.clear();
+    sessionToken.clear();
+    emit logoutSucceeded();
+    qDebug("LEAVE NetworkClient::doLogoutTasks");
+    return;
   }
 
-  uploadPrintJobsTimer->stop();
-  updateUserDataTimer->stop();
+  Scheduler::instance()->stop("uploadPrintJobs");
+  Scheduler::instance()->stop("getUserDataUpdate");
 
   username.clear();
   password.clear();
+  sessionToken.clear();
+  sessionCheckpoint = SessionCheckpoint();
 
-#ifdef Q_OS_WIN
-
-  // If this is an MS Windows platform, use the keylocker programs to limit
-  // mischief.
-  QProcess::startDetached("taskkill /f /im explorer.exe");
-  QProcess::startDetached("windows/on_logout.exe");
-
-  if (actionOnLogout == LogoutAction::Logout) {
-    emit allowClose(true);
-    QProcess::startDetached("shutdown -l -f");
-  } else if (actionOnLogout == LogoutAction::Reboot) {
-    emit allowClose(true);
-    QProcess::startDetached("shutdown -r -f -t 0");
-  }
-#endif  // ifdef Q_OS_WIN
-
-#ifdef Q_OS_UNIX
-
-  if (actionOnLogout == LogoutAction::Logout) {
-    emit allowClose(true);
-
-    // Restart KDE 4
-    QProcess::startDetached(
-        "qdbus org.kde.ksmserver /KSMServer org.kde.KSMServerInterface.logout "
-        "-0 -1 -1");
+  // The next patron waits on the login screen, the rest is cleaned up after
+  // it is back
+  PerfUtils::beginInterval("Logout to login screen");
+  emit logoutSucceeded();
 
-    // Restart Gnome
-    QProcess::startDetached("gnome-session-save --kill --silent");
+  finishLogout();
+  logoutStages << "session" << "print jobs" << "hooks" << "logout action";
+  Scheduler::instance()->startOnce(jobName("runLogoutStage"), 0);
 
-    // Restart Unity
-    QProcess::startDetached("gnome-session-quit --no-prompt");
+  qDebug("LEAVE NetworkClient::doLogoutTasks");
+}
 
-    // Restart XFCE 4
-    QProcess::startDetached("/usr/bin/xfce4-session-logout");
+/* Runs one stage of the logout cleanup per wakeup, so requests and replies
+ * aren't held up behind all of them */
+void NetworkClient::runLogoutStage() {
+  if (logoutStages.isEmpty()) return;
 
-    // Restart Mate
-    QProcess::startDetached("mate-session-save --force-logout");
-  } else if (actionOnLogout == LogoutAction::Reboot) {
-    emit allowClose(true);
+  QString stage = logoutStages.takeFirst();
+  QElapsedTimer timer;
+  timer.start();
 
-    // For this to work, sudo must be installed and the line
-    // %shutdown ALL=(root) NOPASSWD: /sbin/reboot
-    // needs to be added to /etc/sudoers
-    QProcess::startDetached("sudo reboot");
-  }
-#endif  // ifdef Q_OS_UNIX
-  qDebug() << "SCRIPTLOGOUT:"
-           << settings.value("scriptlogout/enable").toString();
-  if (settings.value("scriptlogout/enable").toString() == "1") {
-    QProcess::startDetached(settings.value("scriptlogout/script").toString());
-  }
-  emit logoutSucceeded();
+  QSettings settings;
+  settings.setIniCodec("UTF-8");
 
-  qDebug("LEAVE NetworkClient::doLogoutTasks");
-}
+  if (stage == "session") {
+    settings.setValue("session/LoggedInUser", "");
+    settings.sync();
 
-void NetworkClient::wakeOnLan(QStringList MAC_addresses, QString host,
-                              qint64 port) {
-  qDebug("ENTER NetworkClient::wakeOnLan");
+    SessionCheckpoint::clear();
+  } else if (stage == "print jobs") {
+    // Delete print jobs
+    QSettings printerSettings;
+    printerSettings.beginGroup("printers");
+    QStringList printers = printerSettings.allKeys();
+    foreach (const QString &printer, printers) {
+      QString directory = printerSettings.value(printer).toString();
+      QDir dir(directory);
 
-  QHostAddress host_address;
-  host_address.setAddress(host);
+      dir.setFilter(QDir::Files);
 
-  for (int i = 0; i < MAC_addresses.size(); i++) {
-    char address[6];
-    char packet[102];
+      QFileInfoList list = dir.entryInfoList();
 
-    memset(packet, 0xff, 6);
+      for (int i = 0; i < list.size(); ++i) {
+        QFileInfo fileInfo = list.at(i);
+        QString absoluteFilePath = fileInfo.absoluteFilePath();
+        QFile::remove(absoluteFilePath);
+      }
+    }
+  } else if (stage == "hooks") {
+#ifdef Q_OS_WIN
+    // If this is an MS Windows platform, use the keylocker programs to limit
+    // mischief.
+    ProcessSupervisor *supervisor = ProcessSupervisor::instance();
+    supervisor->detach("taskkill", "taskkill /f /im explorer.exe");
+    supervisor->run("on_logout", "windows/on_logout.exe");
+#endif  // ifdef Q_OS_WIN
 
-    for (int j = 0; j < 6; j++) {
-      address[j] = MAC_addresses.at(i).section(":", j, j).toInt(Q_NULLPTR, 16);
+    qDebug() << "SCRIPTLOGOUT:"
+             << settings.value("scriptlogout/enable").toString();
+    if (settings.value("scriptlogout/enable").toString() == "1") {
+      ProcessSupervisor::instance()->run(
+          "scriptlogout", settings.value("scriptlogout/script").toString());
+    }
+  } else if (stage == "logout action") {
+#ifdef Q_OS_WIN
+    if (actionOnLogout == LogoutAction::Logout) {
+      emit allowClose(true);
+      QProcess::startDetached("shutdown -l -f");
+    } else if (actionOnLogout == LogoutAction::Reboot) {
+      emit allowClose(true);
+      QProcess::startDetached("shutdown -r -f -t 0");
     }
+#endif  // ifdef Q_OS_WIN
 
-    for (int j = 1; j <= 16; j++) {
-      memcpy(&packet[j * 6], &address, 6 * sizeof(char));
+#ifdef Q_OS_UNIX
+    if (actionOnLogout == LogoutAction::Logout) {
+      emit allowClose(true);
+
+      // Only the command of the desktop detected at startup
+      ProcessSupervisor::instance()->logOutDesktop();
+    } else if (actionOnLogout == LogoutAction::Reboot) {
+      emit allowClose(true);
+
+      // For this to work, sudo must be installed and the line
+      // %shutdown ALL=(root) NOPASSWD: /sbin/reboot
+      // needs to be added to /etc/sudoers
+      QProcess::startDetached("sudo reboot");
     }
+#endif  // ifdef Q_OS_UNIX
+  }
 
-    QUdpSocket udpSocket;
-    udpSocket.writeDatagram(packet, 102, host_address, port);
+  qint64 nsecs = timer.nsecsElapsed();
+  PerfUtils::recordDuration("Logout " + stage, nsecs);
+  if (nsecs / 1000000 > LOGOUT_STAGE_BUDGET) {
+    qDebug() << "LOGOUT: " << stage << " took " << nsecs / 1000000
+             << " ms, budget " << LOGOUT_STAGE_BUDGET << " ms";
+    Metrics::incrementCounter("libki_logout_budget_overruns_total",
+                              QString("stage=\"%1\"").arg(stage));
   }
 
-  qDebug("LEAVE NetworkClient::wakeOnLan");
+  if (!logoutStages.isEmpty()) {
+    Scheduler::instance()->startOnce(jobName("runLogoutStage"), 0);
+  }
+}
+
+/* Finishes the previous logout's cleanup at once, before another session
+ * starts or ends */
+void NetworkClient::finishLogout() {
+  Scheduler::instance()->stop(jobName("runLogoutStage"));
+  while (!logoutStages.isEmpty()) runLogoutStage();
 }
 
 void NetworkClient::handleNetworkReplyErrors(QNetworkReply *reply) {
@@ -930,6 +1492,13 @@ void NetworkClient::handleNetworkReplyErrors(QNetworkReply *reply) {
       qDebug() << "ERROR: Server Access Warning: " << e << " :: " << reply->errorString();
 
       QString s = e + ": " + reply->errorString();
+      QString unpinned = reply->property("unpinnedCertificate").toString();
+      if (!unpinned.isEmpty()) {
+        s = e + ": " +
+            tr("the server's certificate %1 doesn't match "
+               "server/certificate_fingerprint")
+                .arg(unpinned);
+      }
       serverAccessWarning(s);
   } else {
       serverAccessWarning("");
@@ -22,11 +22,14 @@
 
 #include <QApplication>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QEventLoop>
 #include <QHash>
+#include <QList>
 #include <QObject>
 #include <QProcess>
 #include <QSettings>
+#include <QStringList>
 #include <QTimer>
 #include <QUrl>
 #include <QUrlQuery>
@@ -37,15 +40,38 @@
 #include <QtScript/QScriptEngine>
 #include <QtScript/QScriptValue>
 
+#include "sessioncheckpoint.h"
+
+class TlsSessionCache;
+class TrafficCapture;
+class TrafficReplay;
+class WakeOnLan;
+
 namespace LogoutAction {
 enum Enum { Logout, Reboot, NoAction };
 }
 
+/* Talks to the Libki server. The client lives in its own thread so reply
+ * processing, settings syncs and print spool scans never block the windows,
+ * it must only be reached through queued signals and slots. */
 class NetworkClient : public QObject {
   Q_OBJECT
 
  public:
-  NetworkClient(QApplication *app);
+  NetworkClient();
+
+#ifdef LIBKI_DEVTOOLS
+  // Turns the client into one node of a simulated fleet, see FleetSimulator.
+  // Must be called before start().
+  void simulateNode(const QString &name, const QString &ipAddress,
+                    const QString &macAddress, const QUrl &server);
+  void simulatePrintJob(int bytes);
+
+  // Answers the client's requests from a capture and makes them again as
+  // recorded, see TrafficReplay. False when the file isn't a capture. Must
+  // be called before start().
+  bool replayCapture(const QString &path, double speed);
+#endif  // ifdef LIBKI_DEVTOOLS
 
  signals:
 
@@ -63,27 +89,40 @@ class NetworkClient : public QObject {
   void clientOnline();
   void serverAccessWarning(QString);
   void internetAccessWarning(QString);
+  void styleSheetChanged(const QString &styleSheet);
+  void sessionLockRestored();
+  void requestFinished(const QString &action, qint64 nsecs, bool ok);
 
  public slots:
 
+  void start();
+
   void attemptLogin(QString username, QString password);
   void attemptLogout();
   void acknowledgeReservation(QString reserved_for);
+  void getUserDataUpdate();
+  void setSessionLocked(bool locked);
+  void warmUpConnection();
+  void releaseIdleConnections();
+  void clearMessage();
 
  private slots:
 
+  void resumeSession();
+  void processResumeSessionReply(QNetworkReply *reply);
+
   void registerNode();
+  void refreshIdentity();
   void processRegisterNodeReply(QNetworkReply *reply);
 
   void uploadPrintJobs();
 
-  void getUserDataUpdate();
   void processGetUserDataUpdateReply(QNetworkReply *reply);
 
-  void clearMessage();
-
   void ignoreNetworkReply(QNetworkReply *reply);
   void uploadPrintJobReply(QNetworkReply *reply);
+  void retryPrintJobs();
+  void runLogoutStage();
   void handleUploadProgress(qint64, qint64);
 
   void processAttemptLoginReply(QNetworkReply *reply);
@@ -96,13 +135,17 @@ class NetworkClient : public QObject {
 
   void handleNetworkReplyErrors(QNetworkReply *reply);
 
+  void dispatchReply(QNetworkReply *reply);
+  void handleEncrypted(QNetworkReply *reply);
+
  private:
-  QApplication *app;
+  QNetworkAccessManager *nam;
+  QElapsedTimer lastWarmUp;
+  QElapsedTimer requestClock;
+  TlsSessionCache *tlsSessionCache;
+  TrafficCapture *trafficCapture;
 
-  QTimer *registerNodeTimer;
-  QTimer *uploadPrintJobsTimer;
-  QTimer *updateUserDataTimer;
-  QTimer *checkForInternetConnectivityTimer;
+  WakeOnLan *wakeOnLan;
 
   QUrl serviceURL;
   QUrlQuery urlQuery;
@@ -121,13 +164,45 @@ class NetworkClient : public QObject {
 
   QString username;
   QString password;
+  // Issued by servers that support resuming a session without the password
+  QString sessionToken;
 
   int fileCounter;
+  int printJobsInFlight;
+  QList<QNetworkReply *> printJobRetries;
+
+  SessionCheckpoint sessionCheckpoint;
+
+  // Cleanup left to do after the login screen is back
+  QStringList logoutStages;
+
+  // Simulated nodes share the process, its settings and its scheduler with
+  // other nodes, they only talk to the server
+  bool simulated;
+  // Replayed nodes only send the requests the replay makes them send
+  bool replaying;
+#ifdef LIBKI_DEVTOOLS
+  TrafficReplay *trafficReplay;
+#endif  // ifdef LIBKI_DEVTOOLS
+
+  QByteArray styleSheetHash;
 
   void doLoginTasks(int units, int hold_items_count);
   void doLogoutTasks();
-
-  void wakeOnLan(QStringList MAC_addresses, QString host, qint64 port);
+  void finishLogout();
+
+  void applyStyleSheet(const QString &styleSheet);
+  void runServerCommands(const QScriptValue &sc);
+  void applyServerSettings(const QScriptValue &sc);
+
+  QNetworkReply *sendRequest(const QUrl &url, const char *handler);
+  QNetworkRequest serverRequest(const QUrl &url);
+  QString replyAction(QNetworkReply *reply) const;
+  void recordReplyMetrics(QNetworkReply *reply);
+  void sendPrintJob(const QString &printer, const QString &fileName,
+                    QIODevice *data);
+  QString jobName(const QString &job) const;
+  void updateUrlQuery();
 
 };
 
@@ -0,0 +1,143 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "notificationcenter.h"
+
+#include <QDebug>
+#include <QStringList>
+
+#include "scheduler.h"
+
+// Milliseconds messages arriving together are gathered into one box
+#define NOTIFICATION_COALESCE_DELAY 250
+// Most messages shown in one box, the rest follow in the next
+#define NOTIFICATION_BATCH 10
+
+NotificationCenter::NotificationCenter(QWidget *window)
+    : QObject(window), window(window) {
+  qDebug("ENTER NotificationCenter::NotificationCenter");
+
+  box = Q_NULLPTR;
+  scheduled = false;
+  unacknowledged = false;
+
+  Scheduler::instance()->addJob("showNotifications", 0, this, "showPending");
+
+  qDebug("LEAVE NotificationCenter::NotificationCenter");
+}
+
+void NotificationCenter::post(QString message, bool fromServer) {
+  qDebug() << QString("ENTER NotificationCenter::post(%1)").arg(message);
+
+  bool folded = false;
+  for (int i = 0; i < queue.size(); i++) {
+    if (queue.at(i).message == message) {
+      queue[i].count++;
+      queue[i].fromServer = queue.at(i).fromServer || fromServer;
+      folded = true;
+      break;
+    }
+  }
+
+  if (!folded) {
+    Notification notification;
+    notification.message = message;
+    notification.count = 1;
+    notification.fromServer = fromServer;
+    queue << notification;
+  }
+
+  // While a box is up, the queue waits for the patron to dismiss it
+  if (!scheduled && !(box && box->isVisible())) {
+    scheduled = true;
+    Scheduler::instance()->startOnce("showNotifications",
+                                     NOTIFICATION_COALESCE_DELAY);
+  }
+
+  qDebug() << QString("LEAVE NotificationCenter::post(%1)").arg(message);
+}
+
+/* The patron has gone, so have the messages meant for them */
+void NotificationCenter::clear() {
+  qDebug("ENTER NotificationCenter::clear");
+
+  queue.clear();
+  scheduled = false;
+  unacknowledged = false;
+  Scheduler::instance()->stop("showNotifications");
+
+  if (box) box->hide();
+
+  qDebug("LEAVE NotificationCenter::clear");
+}
+
+void NotificationCenter::showPending() {
+  qDebug("ENTER NotificationCenter::showPending");
+
+  scheduled = false;
+  if (queue.isEmpty() || (box && box->isVisible())) {
+    qDebug("LEAVE NotificationCenter::showPending");
+    return;
+  }
+
+  if (!box) {
+    box = new QMessageBox(window);
+    box->setWindowModality(Qt::NonModal);
+    box->setWindowIcon(window->windowIcon());
+    box->setIcon(QMessageBox::Information);
+    connect(box, SIGNAL(finished(int)), this, SLOT(dismissed()));
+  }
+
+  QStringList messages;
+  int count = 0;
+  while (!queue.isEmpty() && messages.size() < NOTIFICATION_BATCH) {
+    Notification notification = queue.takeFirst();
+    if (notification.count > 1) {
+      messages << tr("%1 (%2 times)")
+                      .arg(notification.message)
+                      .arg(notification.count);
+    } else {
+      messages << notification.message;
+    }
+    count += notification.count;
+    unacknowledged = unacknowledged || notification.fromServer;
+  }
+
+  box->setText(count > 1 ? tr("You have %1 messages").arg(count)
+                         : tr("You have a message"));
+  box->setInformativeText(messages.join("\n\n"));
+
+  emit showing();
+  box->show();
+  box->raise();
+  box->activateWindow();
+
+  qDebug("LEAVE NotificationCenter::showPending");
+}
+
+void NotificationCenter::dismissed() {
+  qDebug("ENTER NotificationCenter::dismissed");
+
+  if (!queue.isEmpty()) {
+    showPending();
+  } else if (unacknowledged) {
+    unacknowledged = false;
+    emit acknowledged();
+  }
+
+  qDebug("LEAVE NotificationCenter::dismissed");
+}
@@ -0,0 +1,71 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NOTIFICATIONCENTER_H
+#define NOTIFICATIONCENTER_H
+
+#include <QList>
+#include <QMessageBox>
+#include <QObject>
+#include <QString>
+#include <QWidget>
+
+/* Shows messages to the patron without blocking the client. Messages are
+ * queued in the order they arrive, a burst shares one message box with
+ * repeated messages folded together, and the next box shows once the patron
+ * dismissed the previous one. When everything from the server has been
+ * dismissed, acknowledged() is emitted once for the whole batch. */
+class NotificationCenter : public QObject {
+  Q_OBJECT
+
+ public:
+  // The message boxes are shown over the window
+  NotificationCenter(QWidget *window);
+
+ signals:
+
+  void showing();
+  void acknowledged();
+
+ public slots:
+
+  void post(QString message, bool fromServer = true);
+  void clear();
+
+ private slots:
+
+  void showPending();
+  void dismissed();
+
+ private:
+  struct Notification {
+    QString message;
+    int count;
+    bool fromServer;
+  };
+
+  QWidget *window;
+  QMessageBox *box;
+
+  QList<Notification> queue;
+  bool scheduled;
+
+  // Server messages were shown but not acknowledged yet
+  bool unacknowledged;
+};
+
+#endif  // NOTIFICATIONCENTER_H
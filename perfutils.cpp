@@ -0,0 +1,164 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "perfutils.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QStringList>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif  // ifdef Q_OS_LINUX
+
+namespace PerfUtils {
+
+struct DurationStats {
+  DurationStats() : count(0), total(0), max(0) {}
+
+  qint64 count;
+  qint64 total;
+  qint64 max;
+};
+
+static QMutex statsMutex;
+static QHash<QString, DurationStats> durationStats;
+static QHash<QString, QElapsedTimer> intervals;
+
+// Upper bounds in milliseconds of the histogram buckets, the last one is open
+static const qint64 histogramBuckets[] = {100, 250, 500, 1000, 2000, 5000};
+static const int histogramBucketCount =
+    sizeof(histogramBuckets) / sizeof(histogramBuckets[0]);
+
+static QString formatStats(const DurationStats& stats) {
+  qint64 average = stats.count ? stats.total / stats.count : 0;
+  return QString("avg %1 us, max %2 us, n=%3")
+      .arg(average / 1000)
+      .arg(stats.max / 1000)
+      .arg(stats.count);
+}
+
+void recordDuration(const QString& name, qint64 nsecs) {
+  QString summary;
+  {
+    QMutexLocker locker(&statsMutex);
+    DurationStats& stats = durationStats[name];
+    stats.count++;
+    stats.total += nsecs;
+    if (nsecs > stats.max) stats.max = nsecs;
+    summary = formatStats(stats);
+  }
+
+  qDebug() << QString("PERF %1: %2 us (%3)")
+                  .arg(name)
+                  .arg(nsecs / 1000)
+                  .arg(summary);
+}
+
+QString durationSummary(const QString& name) {
+  QMutexLocker locker(&statsMutex);
+  return formatStats(durationStats.value(name));
+}
+
+void beginInterval(const QString& name) {
+  QMutexLocker locker(&statsMutex);
+  intervals[name].start();
+}
+
+qint64 endInterval(const QString& name) {
+  qint64 nsecs;
+  {
+    QMutexLocker locker(&statsMutex);
+    if (!intervals.contains(name)) return -1;
+    nsecs = intervals.take(name).nsecsElapsed();
+  }
+
+  recordDuration(name, nsecs);
+  return nsecs / 1000000;
+}
+
+static QString bucketKey(int bucket) {
+  if (bucket < histogramBucketCount) {
+    return "le_" + QString::number(histogramBuckets[bucket]);
+  }
+  return "over_" + QString::number(histogramBuckets[histogramBucketCount - 1]);
+}
+
+void recordHistogram(const QString& name, qint64 msecs) {
+  QMutexLocker locker(&statsMutex);
+
+  // Kept apart from the client configuration, which administrators edit
+  QSettings histograms(
+      QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) +
+          "/histograms.ini",
+      QSettings::IniFormat);
+  histograms.beginGroup(name);
+
+  int bucket = 0;
+  while (bucket < histogramBucketCount && msecs > histogramBuckets[bucket]) {
+    bucket++;
+  }
+  histograms.setValue(bucketKey(bucket),
+                      histograms.value(bucketKey(bucket), 0).toLongLong() + 1);
+
+  QStringList counts;
+  for (int i = 0; i <= histogramBucketCount; i++) {
+    counts << QString("%1: %2").arg(bucketKey(i)).arg(
+                  histograms.value(bucketKey(i), 0).toLongLong());
+  }
+
+  qDebug() << QString("HISTOGRAM %1: %2 ms (%3)")
+                  .arg(name)
+                  .arg(msecs)
+                  .arg(counts.join(", "));
+}
+
+qint64 residentSetSize() {
+#ifdef Q_OS_LINUX
+  // The second field of statm is the number of resident pages
+  QFile statm("/proc/self/statm");
+  if (statm.open(QIODevice::ReadOnly)) {
+    QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.size() > 1) {
+      return fields.at(1).toLongLong() * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+  }
+#endif  // ifdef Q_OS_LINUX
+  return -1;
+}
+
+int openFileDescriptors() {
+#ifdef Q_OS_LINUX
+  return QDir("/proc/self/fd")
+      .entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot)
+      .size();
+#else
+  return -1;
+#endif  // ifdef Q_OS_LINUX
+}
+
+ScopedTimer::ScopedTimer(const QString& name) : name(name) { timer.start(); }
+
+ScopedTimer::~ScopedTimer() { recordDuration(name, timer.nsecsElapsed()); }
+
+}  // namespace PerfUtils
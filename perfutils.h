@@ -0,0 +1,63 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PERFUTILS_H
+#define PERFUTILS_H
+
+#include <QElapsedTimer>
+#include <QString>
+
+namespace PerfUtils {
+// Records one sample of the named operation and logs it together with the
+// running average and maximum. Safe to call from any thread.
+void recordDuration(const QString& name, qint64 nsecs);
+
+// Returns "avg/max/count" statistics for the named operation.
+QString durationSummary(const QString& name);
+
+// Starts timing an operation that ends somewhere else, e.g. in another
+// window. Starting it again restarts it.
+void beginInterval(const QString& name);
+
+// Ends the named interval, records it and returns its length in
+// milliseconds, or -1 when it wasn't started.
+qint64 endInterval(const QString& name);
+
+// Adds a sample to a histogram kept on disk across restarts and logs it.
+void recordHistogram(const QString& name, qint64 msecs);
+
+// Returns the resident set size of the process in kilobytes, or -1 when it
+// can't be determined on this platform.
+qint64 residentSetSize();
+
+// Returns the number of open file descriptors of the process, or -1 when it
+// can't be determined on this platform.
+int openFileDescriptors();
+
+// Measures the lifetime of the object and records it with recordDuration.
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(const QString& name);
+  ~ScopedTimer();
+
+ private:
+  QString name;
+  QElapsedTimer timer;
+};
+}  // namespace PerfUtils
+
+#endif  // PERFUTILS_H
@@ -0,0 +1,252 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "processsupervisor.h"
+
+#include <QDebug>
+#include <QSettings>
+#include <QThreadStorage>
+
+#include "metrics.h"
+#include "perfutils.h"
+#include "scheduler.h"
+
+// Seconds a hook may run before it is killed, unless node/hook_timeout says
+// otherwise
+#define HOOK_TIMEOUT 60
+// How often running hooks are checked against their timeouts
+#define HOOK_CHECK_INTERVAL 1000
+
+static QThreadStorage<ProcessSupervisor *> supervisors;
+static ProcessSupervisor::Desktop detectedDesktop =
+    ProcessSupervisor::UnknownDesktop;
+
+ProcessSupervisor *ProcessSupervisor::instance() {
+  if (!supervisors.hasLocalData()) {
+    supervisors.setLocalData(new ProcessSupervisor());
+  }
+  return supervisors.localData();
+}
+
+ProcessSupervisor::ProcessSupervisor(QObject *parent) : QObject(parent) {
+  qDebug("ENTER ProcessSupervisor::ProcessSupervisor");
+
+  Scheduler::instance()->addJob("checkHookTimeouts", HOOK_CHECK_INTERVAL, this,
+                                "checkTimeouts");
+
+  qDebug("LEAVE ProcessSupervisor::ProcessSupervisor");
+}
+
+void ProcessSupervisor::detectDesktop() {
+  qDebug("ENTER ProcessSupervisor::detectDesktop");
+
+  QSettings settings;
+  settings.setIniCodec("UTF-8");
+
+  QString session = settings.value("node/desktop").toString().toLower();
+  if (session.isEmpty()) {
+    session = QString::fromLocal8Bit(qgetenv("XDG_CURRENT_DESKTOP") + ':' +
+                                     qgetenv("DESKTOP_SESSION"))
+                  .toLower();
+  }
+
+  // Unity reports itself as a GNOME session too
+  if (session.contains("unity")) {
+    detectedDesktop = UnityDesktop;
+  } else if (session.contains("kde") || session.contains("plasma") ||
+             qEnvironmentVariableIsSet("KDE_FULL_SESSION")) {
+    detectedDesktop = KdeDesktop;
+  } else if (session.contains("xfce")) {
+    detectedDesktop = XfceDesktop;
+  } else if (session.contains("mate") ||
+             qEnvironmentVariableIsSet("MATE_DESKTOP_SESSION_ID")) {
+    detectedDesktop = MateDesktop;
+  } else if (session.contains("gnome") ||
+             qEnvironmentVariableIsSet("GNOME_DESKTOP_SESSION_ID")) {
+    detectedDesktop = GnomeDesktop;
+  } else {
+    detectedDesktop = UnknownDesktop;
+  }
+
+  qDebug() << "DESKTOP: " << session << " detected as " << detectedDesktop;
+
+  qDebug("LEAVE ProcessSupervisor::detectDesktop");
+}
+
+ProcessSupervisor::Desktop ProcessSupervisor::desktop() {
+  return detectedDesktop;
+}
+
+void ProcessSupervisor::run(const QString &name, const QString &command,
+                            int timeoutSecs) {
+  run(name, QStringList() << command, timeoutSecs);
+}
+
+void ProcessSupervisor::run(const QString &name, const QStringList &commands,
+                            int timeoutSecs) {
+  qDebug() << "ENTER ProcessSupervisor::run " << name;
+
+  if (commands.isEmpty()) {
+    qDebug() << "LEAVE ProcessSupervisor::run " << name;
+    return;
+  }
+
+  if (timeoutSecs < 0) {
+    QSettings settings;
+    settings.setIniCodec("UTF-8");
+    timeoutSecs = settings.value("node/hook_timeout", HOOK_TIMEOUT).toInt();
+  }
+
+  Hook hook;
+  hook.name = name;
+  hook.fallbacks = commands.mid(1);
+  hook.timeoutSecs = timeoutSecs;
+  launch(hook, commands.first());
+
+  qDebug() << "LEAVE ProcessSupervisor::run " << name;
+}
+
+bool ProcessSupervisor::detach(const QString &name, const QString &command) {
+  QElapsedTimer clock;
+  clock.start();
+
+  bool started = QProcess::startDetached(command);
+  if (!started) qDebug() << "HOOK: " << name << " failed to start " << command;
+
+  PerfUtils::recordDuration("hook " + name + " launch", clock.nsecsElapsed());
+  return started;
+}
+
+void ProcessSupervisor::logOutDesktop() {
+  qDebug("ENTER ProcessSupervisor::logOutDesktop");
+
+  QString kde =
+      "qdbus org.kde.ksmserver /KSMServer org.kde.KSMServerInterface.logout "
+      "-0 -1 -1";
+  QString gnome = "gnome-session-quit --no-prompt";
+  QString gnome2 = "gnome-session-save --kill --silent";
+  QString xfce = "/usr/bin/xfce4-session-logout";
+  QString mate = "mate-session-save --force-logout";
+
+  QStringList commands;
+  switch (detectedDesktop) {
+    case KdeDesktop:
+      commands << kde;
+      break;
+    case GnomeDesktop:
+      commands << gnome << gnome2;
+      break;
+    case UnityDesktop:
+      commands << gnome;
+      break;
+    case XfceDesktop:
+      commands << xfce;
+      break;
+    case MateDesktop:
+      commands << mate;
+      break;
+    default:
+      // Tried one after the other until one works
+      commands << kde << gnome << gnome2 << xfce << mate;
+  }
+  run("desktop logout", commands, 0);
+
+  qDebug("LEAVE ProcessSupervisor::logOutDesktop");
+}
+
+int ProcessSupervisor::running() const { return hooks.size(); }
+
+void ProcessSupervisor::launch(const Hook &hook, const QString &command) {
+  qDebug() << "HOOK: " << hook.name << " runs " << command;
+
+  QProcess *process = new QProcess(this);
+  process->setProcessChannelMode(QProcess::ForwardedChannels);
+  connect(process, SIGNAL(finished(int, QProcess::ExitStatus)), this,
+          SLOT(processFinished(int, QProcess::ExitStatus)));
+  connect(process, SIGNAL(error(QProcess::ProcessError)), this,
+          SLOT(processError(QProcess::ProcessError)));
+
+  hooks.insert(process, hook);
+  hooks[process].clock.start();
+  process->start(command);
+
+  if (hook.timeoutSecs > 0) {
+    Scheduler::instance()->start("checkHookTimeouts");
+  }
+}
+
+void ProcessSupervisor::processFinished(int exitCode,
+                                        QProcess::ExitStatus exitStatus) {
+  QProcess *process = qobject_cast<QProcess *>(sender());
+  if (!hooks.contains(process)) return;
+
+  qDebug() << "HOOK: " << hooks.value(process).name << " exited with "
+           << exitCode;
+  retire(process, exitStatus != QProcess::NormalExit || exitCode != 0);
+}
+
+void ProcessSupervisor::processError(QProcess::ProcessError error) {
+  // Other errors are followed by finished()
+  if (error != QProcess::FailedToStart) return;
+
+  QProcess *process = qobject_cast<QProcess *>(sender());
+  if (!hooks.contains(process)) return;
+
+  qDebug() << "HOOK: " << hooks.value(process).name << " failed to start";
+  retire(process, true);
+}
+
+/* Records how long the hook ran, and runs its next command if it failed */
+void ProcessSupervisor::retire(QProcess *process, bool failed) {
+  Hook hook = hooks.take(process);
+  process->deleteLater();
+
+  qint64 nsecs = hook.clock.nsecsElapsed();
+  QString labels = QString("hook=\"%1\"").arg(hook.name);
+  PerfUtils::recordDuration("hook " + hook.name, nsecs);
+  Metrics::observe("libki_hook_duration_seconds", labels, nsecs / 1e9);
+  if (failed) Metrics::incrementCounter("libki_hook_failures_total", labels);
+
+  if (failed && !hook.timedOut && !hook.fallbacks.isEmpty()) {
+    QString command = hook.fallbacks.takeFirst();
+    launch(hook, command);
+  }
+}
+
+void ProcessSupervisor::checkTimeouts() {
+  bool watching = false;
+
+  QHash<QProcess *, Hook>::iterator it;
+  for (it = hooks.begin(); it != hooks.end(); ++it) {
+    Hook &hook = it.value();
+    if (hook.timeoutSecs <= 0 || hook.timedOut) continue;
+
+    if (hook.clock.elapsed() >= 1000 * qint64(hook.timeoutSecs)) {
+      qDebug() << "HOOK: " << hook.name << " ran longer than "
+               << hook.timeoutSecs << " seconds, killed";
+      Metrics::incrementCounter("libki_hook_timeouts_total",
+                                QString("hook=\"%1\"").arg(hook.name));
+      hook.timedOut = true;
+      // finished() follows once the process is gone
+      it.key()->kill();
+    } else {
+      watching = true;
+    }
+  }
+
+  if (!watching) Scheduler::instance()->stop("checkHookTimeouts");
+}
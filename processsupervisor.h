@@ -0,0 +1,94 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROCESSSUPERVISOR_H
+#define PROCESSSUPERVISOR_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QProcess>
+#include <QString>
+#include <QStringList>
+
+/* Runs the login and logout hooks and the desktop session's logout. Hooks
+ * are tracked until they exit and killed when they overrun their timeout,
+ * their run time is recorded (see PerfUtils and the libki_hook_* metrics). A
+ * hook can have fallback commands, the next one runs only when the previous
+ * one failed to start or failed. The desktop environment is detected once at
+ * startup, so logging out of the session runs only that desktop's command.
+ * There is one supervisor per thread, the hooks' processes belong to it. */
+class ProcessSupervisor : public QObject {
+  Q_OBJECT
+
+ public:
+  enum Desktop {
+    UnknownDesktop,
+    KdeDesktop,
+    GnomeDesktop,
+    UnityDesktop,
+    XfceDesktop,
+    MateDesktop
+  };
+
+  static ProcessSupervisor *instance();
+
+  // Called once at startup, before the network thread starts. The
+  // node/desktop setting overrides what the environment says.
+  static void detectDesktop();
+  static Desktop desktop();
+
+  // Runs a hook, killed after timeoutSecs unless that is 0. By default the
+  // timeout is node/hook_timeout.
+  void run(const QString &name, const QString &command, int timeoutSecs = -1);
+  void run(const QString &name, const QStringList &commands,
+           int timeoutSecs = -1);
+
+  // Starts a program meant to outlive the hook, e.g. a browser, untracked
+  bool detach(const QString &name, const QString &command);
+
+  // Ends the desktop session the kiosk runs in
+  void logOutDesktop();
+
+  int running() const;
+
+ private slots:
+
+  void processFinished(int exitCode, QProcess::ExitStatus exitStatus);
+  void processError(QProcess::ProcessError error);
+  void checkTimeouts();
+
+ private:
+  struct Hook {
+    Hook() : timeoutSecs(0), timedOut(false) {}
+
+    QString name;
+    QStringList fallbacks;
+    int timeoutSecs;
+    bool timedOut;
+    QElapsedTimer clock;
+  };
+
+  ProcessSupervisor(QObject *parent = 0);
+
+  QHash<QProcess *, Hook> hooks;
+
+  void launch(const Hook &hook, const QString &command);
+  void retire(QProcess *process, bool failed);
+};
+
+#endif  // PROCESSSUPERVISOR_H
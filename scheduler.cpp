@@ -0,0 +1,251 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "scheduler.h"
+
+#include <QDebug>
+#include <QMetaObject>
+#include <QStringList>
+#include <QThread>
+#include <QThreadStorage>
+
+#include "metrics.h"
+
+// Share of its interval a job that isn't precise may be run early
+#define SCHEDULER_SLACK_DIVISOR 10
+
+static QThreadStorage<Scheduler *> schedulers;
+
+Scheduler *Scheduler::instance() {
+  if (!schedulers.hasLocalData()) {
+    schedulers.setLocalData(new Scheduler());
+  }
+  return schedulers.localData();
+}
+
+Scheduler::Scheduler(QObject *parent) : QObject(parent) {
+  qDebug("ENTER Scheduler::Scheduler");
+
+  clock.start();
+
+  minuteStart = 0;
+  wakeupsThisMinute = 0;
+  wakeupsLastMinute = 0;
+
+  timer = new QTimer(this);
+  timer->setSingleShot(true);
+  connect(timer, SIGNAL(timeout()), this, SLOT(wakeup()));
+
+  qDebug("LEAVE Scheduler::Scheduler");
+}
+
+void Scheduler::addJob(const QString &name, int intervalMsecs,
+                       QObject *receiver, const char *member, bool precise) {
+  qDebug() << "Scheduler::addJob " << name << intervalMsecs;
+
+  Job job;
+  job.receiver = receiver;
+  job.member = member;
+  job.interval = intervalMsecs;
+  job.precise = precise;
+  jobs.insert(name, job);
+}
+
+void Scheduler::start(const QString &name) {
+  if (!jobs.contains(name)) {
+    qDebug() << "Scheduler::start unknown job " << name;
+    return;
+  }
+
+  Job &job = jobs[name];
+  job.active = true;
+  job.once = false;
+  job.due = nextAlignedDeadline(job, clock.elapsed());
+
+  rearm();
+}
+
+void Scheduler::startOnce(const QString &name, int delayMsecs) {
+  if (!jobs.contains(name)) {
+    qDebug() << "Scheduler::startOnce unknown job " << name;
+    return;
+  }
+
+  Job &job = jobs[name];
+  job.active = true;
+  job.once = true;
+  job.due = clock.elapsed() + delayMsecs;
+
+  rearm();
+}
+
+void Scheduler::stop(const QString &name) {
+  if (!jobs.contains(name)) return;
+
+  jobs[name].active = false;
+  rearm();
+}
+
+void Scheduler::setInterval(const QString &name, int intervalMsecs) {
+  if (!jobs.contains(name)) return;
+
+  Job &job = jobs[name];
+  job.interval = intervalMsecs;
+  if (job.active && !job.once) {
+    job.due = nextAlignedDeadline(job, clock.elapsed());
+    rearm();
+  }
+}
+
+void Scheduler::setPhase(const QString &name, int phaseMsecs) {
+  if (!jobs.contains(name)) return;
+
+  Job &job = jobs[name];
+  job.phase = phaseMsecs;
+  if (job.active && !job.once) {
+    job.due = nextAlignedDeadline(job, clock.elapsed());
+    rearm();
+  }
+}
+
+bool Scheduler::isActive(const QString &name) const {
+  return jobs.value(name).active;
+}
+
+int Scheduler::wakeupsPerMinute() const { return wakeupsLastMinute; }
+
+QString Scheduler::statistics() const {
+  QStringList lines;
+  lines << QString("wakeups/min: %1").arg(wakeupsLastMinute);
+
+  QHash<QString, Job>::const_iterator i;
+  for (i = jobs.constBegin(); i != jobs.constEnd(); ++i) {
+    const Job &job = i.value();
+    qint64 average = job.runs ? job.totalNsecs / job.runs : 0;
+    lines << QString("%1: runs %2, avg %3 us, max %4 us")
+                 .arg(i.key())
+                 .arg(job.runs)
+                 .arg(average / 1000)
+                 .arg(job.maxNsecs / 1000);
+  }
+
+  return lines.join("; ");
+}
+
+/* Deadlines are multiples of the interval counted from the scheduler's
+ * epoch, so e.g. every 2s, 10s and 60s job fires together each minute. Jobs
+ * with a phase are shifted by it. */
+qint64 Scheduler::nextAlignedDeadline(const Job &job, qint64 now) const {
+  if (job.interval <= 0) return now;
+  if (now < job.phase) return job.phase;
+  return ((now - job.phase) / job.interval + 1) * job.interval + job.phase;
+}
+
+void Scheduler::rearm() {
+  qint64 next = -1;
+  bool precise = false;
+
+  QHash<QString, Job>::const_iterator i;
+  for (i = jobs.constBegin(); i != jobs.constEnd(); ++i) {
+    const Job &job = i.value();
+    if (!job.active) continue;
+
+    if (next < 0 || job.due < next) {
+      next = job.due;
+      precise = job.precise;
+    }
+  }
+
+  if (next < 0) {
+    timer->stop();
+    return;
+  }
+
+  timer->setTimerType(precise ? Qt::PreciseTimer : Qt::CoarseTimer);
+  timer->start(int(qMax(qint64(0), next - clock.elapsed())));
+}
+
+void Scheduler::wakeup() {
+  qint64 now = clock.elapsed();
+
+  wakeupsThisMinute++;
+  if (now - minuteStart >= 60000) {
+    wakeupsLastMinute = wakeupsThisMinute;
+    wakeupsThisMinute = 0;
+    minuteStart = now;
+    qDebug() << "SCHEDULER: " << statistics();
+
+    QString thread = QThread::currentThread()->objectName();
+    Metrics::setGauge(
+        "libki_timer_wakeups_per_minute",
+        QString("thread=\"%1\"").arg(thread.isEmpty() ? "main" : thread),
+        wakeupsLastMinute);
+  }
+
+  // Collect every job that is due, or close enough to due to share this
+  // wakeup, before running any of them
+  QStringList dueJobs;
+  QHash<QString, Job>::const_iterator i;
+  for (i = jobs.constBegin(); i != jobs.constEnd(); ++i) {
+    const Job &job = i.value();
+    if (!job.active) continue;
+
+    qint64 slack =
+        job.precise || job.once ? 0 : job.interval / SCHEDULER_SLACK_DIVISOR;
+    if (job.due - slack <= now) dueJobs << i.key();
+  }
+
+  // Move the deadlines forward and rearm before running anything, a job
+  // opening a nested event loop must not stall the other jobs
+  QList<Job> runs;
+  QStringList runNames;
+  foreach (const QString &name, dueJobs) {
+    Job &job = jobs[name];
+    if (!job.receiver) {
+      jobs.remove(name);
+      continue;
+    }
+
+    if (job.once) {
+      job.active = false;
+    } else {
+      job.due = nextAlignedDeadline(job, qMax(now, job.due));
+    }
+    runs << job;
+    runNames << name;
+  }
+  rearm();
+
+  for (int j = 0; j < runs.size(); j++) {
+    const Job &job = runs.at(j);
+    if (!job.receiver) continue;
+
+    QElapsedTimer runTimer;
+    runTimer.start();
+    QMetaObject::invokeMethod(job.receiver, job.member.constData(),
+                              Qt::DirectConnection);
+    qint64 elapsed = runTimer.nsecsElapsed();
+
+    QString name = runNames.at(j);
+    if (jobs.contains(name)) {
+      Job &ran = jobs[name];
+      ran.runs++;
+      ran.totalNsecs += elapsed;
+      if (elapsed > ran.maxNsecs) ran.maxNsecs = elapsed;
+    }
+  }
+}
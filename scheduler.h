@@ -0,0 +1,102 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QTimer>
+
+/* Runs the client's periodic jobs from a single timer. Deadlines of periodic
+ * jobs are aligned to multiples of their interval from a common epoch, so
+ * jobs with related intervals share wakeups, and jobs that don't need to be
+ * precise are allowed to run early to join an earlier wakeup. There is one
+ * scheduler per thread. */
+class Scheduler : public QObject {
+  Q_OBJECT
+
+ public:
+  static Scheduler *instance();
+
+  // Registers a job calling the given slot (by name, e.g. "registerNode").
+  // Precise jobs run as close to their deadline as possible, others may be
+  // run up to a tenth of their interval early.
+  void addJob(const QString &name, int intervalMsecs, QObject *receiver,
+              const char *member, bool precise = false);
+
+  void start(const QString &name);
+  void startOnce(const QString &name, int delayMsecs);
+  void stop(const QString &name);
+  void setInterval(const QString &name, int intervalMsecs);
+
+  // Offsets the aligned deadlines of a periodic job
+  void setPhase(const QString &name, int phaseMsecs);
+  bool isActive(const QString &name) const;
+
+  int wakeupsPerMinute() const;
+  QString statistics() const;
+
+ private slots:
+
+  void wakeup();
+
+ private:
+  struct Job {
+    Job()
+        : interval(0),
+          phase(0),
+          precise(false),
+          active(false),
+          once(false),
+          due(0),
+          runs(0),
+          totalNsecs(0),
+          maxNsecs(0) {}
+
+    QPointer<QObject> receiver;
+    QByteArray member;
+    int interval;
+    int phase;
+    bool precise;
+    bool active;
+    bool once;
+    qint64 due;
+
+    qint64 runs;
+    qint64 totalNsecs;
+    qint64 maxNsecs;
+  };
+
+  Scheduler(QObject *parent = 0);
+
+  QTimer *timer;
+  QElapsedTimer clock;
+  QHash<QString, Job> jobs;
+
+  qint64 minuteStart;
+  int wakeupsThisMinute;
+  int wakeupsLastMinute;
+
+  qint64 nextAlignedDeadline(const Job &job, qint64 now) const;
+  void rearm();
+};
+
+#endif  // SCHEDULER_H
@@ -0,0 +1,120 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sessioncheckpoint.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#define SESSION_CHECKPOINT_VERSION 2
+
+SessionCheckpoint::SessionCheckpoint()
+    : secondsRemaining(0), savedAt(0), locked(false) {}
+
+bool SessionCheckpoint::isValid() const {
+  return !username.isEmpty() && savedAt > 0;
+}
+
+bool SessionCheckpoint::canResume() const {
+  return !token.isEmpty() || !password.isEmpty();
+}
+
+bool SessionCheckpoint::isExpired() const {
+  qint64 now = QDateTime::currentMSecsSinceEpoch();
+  return savedAt + 1000 * secondsRemaining < now;
+}
+
+bool SessionCheckpoint::save() {
+  qDebug("ENTER SessionCheckpoint::save");
+
+  savedAt = QDateTime::currentMSecsSinceEpoch();
+
+  QJsonObject checkpoint;
+  checkpoint["version"] = SESSION_CHECKPOINT_VERSION;
+  checkpoint["username"] = username;
+  if (!token.isEmpty()) checkpoint["token"] = token;
+  if (!password.isEmpty()) checkpoint["password"] = password;
+  checkpoint["seconds_remaining"] = double(secondsRemaining);
+  checkpoint["saved_at"] = double(savedAt);
+  checkpoint["locked"] = locked;
+
+  QDir().mkpath(QFileInfo(path()).absolutePath());
+
+  // The temporary file gets the permissions before anything is written to it
+  QSaveFile file(path());
+  bool saved = file.open(QIODevice::WriteOnly);
+  if (saved) {
+    file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+    file.write(QJsonDocument(checkpoint).toJson(QJsonDocument::Compact));
+    saved = file.commit();
+  }
+
+  if (!saved) {
+    qDebug() << "Unable to save session checkpoint " << path();
+  }
+
+  qDebug("LEAVE SessionCheckpoint::save");
+  return saved;
+}
+
+SessionCheckpoint SessionCheckpoint::load() {
+  qDebug("ENTER SessionCheckpoint::load");
+
+  SessionCheckpoint checkpoint;
+
+  QFile file(path());
+  if (file.open(QIODevice::ReadOnly)) {
+    QJsonObject object = QJsonDocument::fromJson(file.readAll()).object();
+
+    if (object["version"].toInt() == SESSION_CHECKPOINT_VERSION) {
+      checkpoint.username = object["username"].toString();
+      checkpoint.token = object["token"].toString();
+      checkpoint.password = object["password"].toString();
+      checkpoint.secondsRemaining =
+          qint64(object["seconds_remaining"].toDouble());
+      checkpoint.savedAt = qint64(object["saved_at"].toDouble());
+      checkpoint.locked = object["locked"].toBool();
+    } else {
+      // Older checkpoints held the password in any case
+      file.close();
+      clear();
+    }
+  }
+
+  qDebug("LEAVE SessionCheckpoint::load");
+  return checkpoint;
+}
+
+void SessionCheckpoint::clear() {
+  qDebug("ENTER SessionCheckpoint::clear");
+
+  QFile::remove(path());
+
+  qDebug("LEAVE SessionCheckpoint::clear");
+}
+
+QString SessionCheckpoint::path() {
+  return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) +
+         "/session.json";
+}
@@ -0,0 +1,60 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SESSIONCHECKPOINT_H
+#define SESSIONCHECKPOINT_H
+
+#include <QString>
+
+/* The state needed to pick up a session after the client crashed or was
+ * killed. It is written atomically, readable by the owner only, whenever the
+ * session changes and removed at logout. The server checks the session token
+ * it issued at login on resume. Servers without tokens need the patron's
+ * password, which is only stored when node/checkpoint_password allows it
+ * and is then kept for the whole session, until the logout. */
+class SessionCheckpoint {
+ public:
+  SessionCheckpoint();
+
+  QString username;
+  QString token;
+  QString password;
+
+  // Time left as last reported by the server, and when that was
+  qint64 secondsRemaining;
+  qint64 savedAt;
+
+  bool locked;
+
+  bool isValid() const;
+
+  // True when there is something the server can check the patron with
+  bool canResume() const;
+
+  // True when the session would have run out by now even without a logout
+  bool isExpired() const;
+
+  bool save();
+
+  static SessionCheckpoint load();
+  static void clear();
+
+ private:
+  static QString path();
+};
+
+#endif  // SESSIONCHECKPOINT_H
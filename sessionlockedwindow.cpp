@@ -5,15 +5,11 @@
 
 #include "utils.h"
 
-SessionLockedWindow::SessionLockedWindow(QWidget *parent, QString userUsername,
-                                         QString userPassword)
-    : QMainWindow(parent) {
+SessionLockedWindow::SessionLockedWindow(QWidget *parent) : QMainWindow(parent) {
   qDebug("ENTER SessionLockedWindow::SessionLockedWindow");
 
-  username = userUsername;
-  password = userPassword;
-
   setAllowClose(false);
+  logoLoaded = false;
 
   setupUi(this);
 
@@ -36,12 +32,30 @@ SessionLockedWindow::SessionLockedWindow(QWidget *parent, QString userUsername,
 
   setupActions();
 
-  getSettings();
-
   clientNameLabel->setText(getClientName());
 
   // handleBanners(); // Do we really want banners on the lock screen?
 
+  qDebug("LEAVE SessionLockedWindow::SessionLockedWindow");
+}
+
+SessionLockedWindow::~SessionLockedWindow() {}
+
+void SessionLockedWindow::setCredentials(const QString &newUsername,
+                                         const QString &newPassword) {
+  username = newUsername;
+  password = newPassword;
+}
+
+/* The window is reused for every lock, it starts over each time */
+void SessionLockedWindow::showMe() {
+  qDebug("ENTER SessionLockedWindow::showMe");
+
+  getSettings();
+
+  messageLabel->clear();
+  passwordField->clear();
+
   this->show();
   this->showMaximized();
   this->showFullScreen();
@@ -49,11 +63,9 @@ SessionLockedWindow::SessionLockedWindow(QWidget *parent, QString userUsername,
   this->raise();  // for MacOS
   this->activateWindow(); // for Windows
 
-  qDebug("LEAVE SessionLockedWindow::SessionLockedWindow");
+  qDebug("LEAVE SessionLockedWindow::showMe");
 }
 
-SessionLockedWindow::~SessionLockedWindow() {}
-
 void SessionLockedWindow::setAllowClose(bool close) {
   qDebug("ENTER SessionLockedWindow::setAllowClose");
 
@@ -87,13 +99,19 @@ void SessionLockedWindow::getSettings() {
     passwordLabel->setText(label);
   }
 
-  if (!settings.value("images/logo").toString().isEmpty()) {
-    logo->hide();
+  // Only reloaded when the server pushed another logo since the last lock
+  QString logoUrl = settings.value("images/logo").toString();
+  if (logoLoaded && logoUrl == loadedLogoUrl) {
+    qDebug("LEAVE SessionLockedWindow::getSettings");
+    return;
+  }
+  logoLoaded = true;
+  loadedLogoUrl = logoUrl;
 
-    QPalette palette = logoWebView->palette();
-    palette.setBrush(QPalette::Base, Qt::transparent);
+  if (!logoUrl.isEmpty()) {
+    logo->hide();
+    logoWebView->show();
 
-    QString logoUrl = settings.value("images/logo").toString();
     qDebug() << "Logo URL: " << logoUrl;
 
     if (!logoUrl.isEmpty()) {
@@ -106,11 +124,10 @@ void SessionLockedWindow::getSettings() {
       if (logoHeight) logoWebView->setMaximumHeight(logoHeight);
 
       logoWebView->setEnabled(true);
-      logoWebView->page()->setPalette(palette);
-      logoWebView->setAttribute(Qt::WA_OpaquePaintEvent, false);
       logoWebView->load(QUrl(logoUrl));
     }
   } else {
+    logo->show();
     logoWebView->hide();
   }
 
@@ -122,7 +139,9 @@ void SessionLockedWindow::attemptUnlock() {
 
   QString passwordEntered = passwordField->text();
 
-  if (passwordEntered == password) {
+  // An empty password only unlocks when patrons log in without one
+  if (passwordEntered == password &&
+      (!password.isEmpty() || !passwordsRequired())) {
     passwordField->clear();
     emit unlockSession();
   } else {
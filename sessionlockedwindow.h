@@ -31,12 +31,16 @@ class SessionLockedWindow : public QMainWindow, public Ui::SessionLockedWindow {
   Q_OBJECT
 
  public:
-  SessionLockedWindow(QWidget *parent = 0, QString userUsername = "",
-                      QString userPassowrd = "");
+  SessionLockedWindow(QWidget *parent = 0);
   ~SessionLockedWindow();
 
   void closeEvent(QCloseEvent *event);
 
+  // The patron whose password unlocks the session
+  void setCredentials(const QString &username, const QString &password);
+
+  void showMe();
+
  signals:
 
   void unlockSession();
@@ -59,9 +63,11 @@ class SessionLockedWindow : public QMainWindow, public Ui::SessionLockedWindow {
   bool allowClose;
   bool isHidden;
 
+  bool logoLoaded;
+  QString loadedLogoUrl;
+
   void setupActions();
   void getSettings();
-  void showMe();
   void setButtonsEnabled(bool);
 };
 
@@ -0,0 +1,94 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stallmonitor.h"
+
+#include <QAbstractEventDispatcher>
+#include <QDebug>
+
+#include "metrics.h"
+
+// Stalls at least this long (in milliseconds) are counted as noticeable
+#define STALL_THRESHOLD 50
+
+StallMonitor::StallMonitor(QObject *parent) : QObject(parent) {
+  qDebug("ENTER StallMonitor::StallMonitor");
+
+  busy = false;
+  minuteStart = 0;
+  longestStall = 0;
+  previousLongestStall = 0;
+  stallsThisMinute = 0;
+
+  clock.start();
+
+  QAbstractEventDispatcher *dispatcher = QAbstractEventDispatcher::instance();
+  if (dispatcher) {
+    connect(dispatcher, SIGNAL(awake()), this, SLOT(awake()),
+            Qt::DirectConnection);
+    connect(dispatcher, SIGNAL(aboutToBlock()), this, SLOT(aboutToBlock()),
+            Qt::DirectConnection);
+  } else {
+    qDebug("StallMonitor: no event dispatcher in this thread");
+  }
+
+  qDebug("LEAVE StallMonitor::StallMonitor");
+}
+
+qint64 StallMonitor::longestStallLastMinute() const {
+  return previousLongestStall;
+}
+
+void StallMonitor::awake() {
+  if (!busy) {
+    busy = true;
+    busyTimer.start();
+  }
+}
+
+void StallMonitor::aboutToBlock() {
+  if (busy) {
+    busy = false;
+
+    qint64 stall = busyTimer.elapsed();
+    if (stall > longestStall) longestStall = stall;
+    if (stall >= STALL_THRESHOLD) {
+      stallsThisMinute++;
+      Metrics::incrementCounter("libki_main_thread_stalls_total");
+      Metrics::incrementCounter("libki_main_thread_stall_seconds_total",
+                                QString(), stall / 1000.0);
+    }
+  }
+
+  rollOver(clock.elapsed());
+}
+
+void StallMonitor::rollOver(qint64 now) {
+  if (now - minuteStart < 60000) return;
+
+  previousLongestStall = longestStall;
+  Metrics::setGauge("libki_main_thread_longest_stall_seconds", QString(),
+                    longestStall / 1000.0);
+  qDebug() << QString("STALL: longest %1 ms, %2 over %3 ms in the last minute")
+                  .arg(longestStall)
+                  .arg(stallsThisMinute)
+                  .arg(STALL_THRESHOLD);
+
+  minuteStart = now;
+  longestStall = 0;
+  stallsThisMinute = 0;
+}
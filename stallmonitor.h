@@ -0,0 +1,54 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STALLMONITOR_H
+#define STALLMONITOR_H
+
+#include <QElapsedTimer>
+#include <QObject>
+
+/* Measures how long the event loop of the thread it is created in spends
+ * between waking up and going back to sleep. Anything longer than a frame
+ * or two is visible to the patron as a frozen window. The longest stall and
+ * the number of noticeable stalls are logged once a minute. */
+class StallMonitor : public QObject {
+  Q_OBJECT
+
+ public:
+  StallMonitor(QObject *parent = 0);
+
+  qint64 longestStallLastMinute() const;
+
+ private slots:
+
+  void awake();
+  void aboutToBlock();
+
+ private:
+  QElapsedTimer clock;
+  QElapsedTimer busyTimer;
+  bool busy;
+
+  qint64 minuteStart;
+  qint64 longestStall;
+  qint64 previousLongestStall;
+  int stallsThisMinute;
+
+  void rollOver(qint64 now);
+};
+
+#endif  // STALLMONITOR_H
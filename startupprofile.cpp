@@ -0,0 +1,110 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "startupprofile.h"
+
+#include <stdio.h>
+
+#include <QAbstractEventDispatcher>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+
+#include "perfutils.h"
+
+static QMutex profileMutex;
+static QElapsedTimer startupClock;
+static qint64 lastPhase = 0;
+static bool printing = false;
+static QSet<QString> milestones;
+
+static void output(const QString &line) {
+  qDebug() << line;
+  if (printing) {
+    fprintf(stderr, "%s\n", line.toLocal8Bit().constData());
+    fflush(stderr);
+  }
+}
+
+void StartupProfile::begin(int argc, char *argv[]) {
+  startupClock.start();
+
+  for (int i = 1; i < argc; i++) {
+    if (qstrcmp(argv[i], "--startup-profile") == 0) printing = true;
+  }
+}
+
+void StartupProfile::phase(const QString &name) {
+  qint64 now;
+  qint64 length;
+  {
+    QMutexLocker locker(&profileMutex);
+    if (!startupClock.isValid()) return;
+    now = startupClock.nsecsElapsed();
+    length = now - lastPhase;
+    lastPhase = now;
+  }
+
+  output(QString("STARTUP %1 ms %2 ms  %3")
+             .arg(now / 1e6, 8, 'f', 1)
+             .arg("+" + QString::number(length / 1e6, 'f', 1), 9)
+             .arg(name));
+}
+
+void StartupProfile::milestone(const QString &name) {
+  qint64 now;
+  {
+    QMutexLocker locker(&profileMutex);
+    if (!startupClock.isValid() || milestones.contains(name)) return;
+    milestones.insert(name);
+    now = startupClock.nsecsElapsed();
+  }
+
+  output(QString("STARTUP %1 ms %2     %3")
+             .arg(now / 1e6, 8, 'f', 1)
+             .arg("", 9)
+             .arg(name));
+}
+
+void StartupProfile::watchForInteractive() {
+  QAbstractEventDispatcher *dispatcher = QAbstractEventDispatcher::instance();
+  if (!dispatcher) return;
+
+  StartupProfile *profile = new StartupProfile();
+  profile->setParent(dispatcher);
+  connect(dispatcher, SIGNAL(aboutToBlock()), profile, SLOT(interactive()),
+          Qt::DirectConnection);
+}
+
+StartupProfile::StartupProfile() : QObject() {}
+
+/* The pending events, including the login screen's first paint, have been
+ * handled and the GUI thread waits for input */
+void StartupProfile::interactive() {
+  sender()->disconnect(this);
+  deleteLater();
+
+  phase("interactive");
+
+  // Kept across restarts, so cold and warm starts can be told apart
+  PerfUtils::recordHistogram("Time to interactive",
+                             startupClock.elapsed());
+  qDebug() << QString("STARTUP: interactive, RSS %1 kB")
+                  .arg(PerfUtils::residentSetSize());
+}
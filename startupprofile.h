@@ -0,0 +1,54 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STARTUPPROFILE_H
+#define STARTUPPROFILE_H
+
+#include <QObject>
+#include <QString>
+
+/* Times the client's startup. The phases of main() are logged with their
+ * length and the time since the process started, work finishing on other
+ * threads (the node's identity, the first registration) with the time only.
+ * The login screen counts as interactive once the GUI thread's event loop
+ * first goes idle after it was shown. With --startup-profile on the command
+ * line every line is also printed to stderr. */
+class StartupProfile : public QObject {
+  Q_OBJECT
+
+ public:
+  // Starts the clock, must be called first thing in main()
+  static void begin(int argc, char *argv[]);
+
+  // Ends a phase of the GUI thread's startup
+  static void phase(const QString &name);
+
+  // Records work finished on another thread. Safe to call from any thread.
+  static void milestone(const QString &name);
+
+  // Records the time to interactive once the event loop is idle
+  static void watchForInteractive();
+
+ private slots:
+
+  void interactive();
+
+ private:
+  StartupProfile();
+};
+
+#endif  // STARTUPPROFILE_H
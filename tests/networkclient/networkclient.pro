@@ -0,0 +1,6 @@
+TEMPLATE = app
+TARGET = tst_networkclient
+
+include(../tests.pri)
+
+SOURCES += tst_networkclient.cpp
@@ -0,0 +1,345 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QList>
+#include <QSettings>
+#include <QSignalSpy>
+#include <QtTest>
+
+#include "faultinjector.h"
+#include "mockserver.h"
+#include "networkclient.h"
+#include "perfutils.h"
+#include "sessioncheckpoint.h"
+#include "testsupport.h"
+
+// Milliseconds a step of a session may take against the local mock server
+#define STEP_BUDGET 200
+// Milliseconds before a step that never finishes is failed
+#define STEP_TIMEOUT 5000
+#define PRINT_JOB_BYTES (256 * 1024)
+
+#define RECOVERY_NODES 5
+// Every request fails at the proxy during the outage
+#define OUTAGE_FAULTS "default=error:1:502"
+#define OUTAGE_SECONDS 5
+// Attempts of a print job during the outage, the retries back off from a
+// second
+#define OUTAGE_PRINT_ATTEMPTS 5
+// Seconds after the outage the print jobs have to reach the server
+#define RECOVERY_TIMEOUT 60
+
+// Simulated days of the soak, LIBKI_SOAK_DAYS runs a longer one
+#define SOAK_DAYS 3
+#define SOAK_SESSIONS_PER_DAY 100
+// A half hour session polls the server about this often, compressed
+#define SOAK_HEARTBEATS_PER_SESSION 20
+#define SOAK_PRINT_JOB_BYTES (64 * 1024)
+// Growth tolerated after the first day, which fills the caches and
+// connection pools
+#define SOAK_RSS_BUDGET 2048
+#define SOAK_OBJECT_BUDGET 16
+#define SOAK_DESCRIPTOR_BUDGET 4
+
+/* NetworkClient against an in-process MockServer */
+class TestNetworkClient : public QObject {
+  Q_OBJECT
+
+ private slots:
+
+  void session();
+  void lockedResumeWithoutPassword();
+  void recovery();
+  void soak();
+};
+
+/* What a soak keeps an eye on at the end of a day */
+struct SoakSample {
+  qint64 rss;
+  int objects;
+  int descriptors;
+};
+
+static SoakSample soakSample(QObject *owner) {
+  // Replies and uploads of the last session are deleted later
+  QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+
+  SoakSample sample;
+  sample.rss = PerfUtils::residentSetSize();
+  sample.objects = owner->findChildren<QObject *>().size();
+  sample.descriptors = PerfUtils::openFileDescriptors();
+  return sample;
+}
+
+/* A patron's session: registration, a rejected and an accepted login, an
+ * update, a print job, a reservation and the logout. Every step must end
+ * with its signal within the budget, and the server must see exactly the
+ * requests the session makes. */
+void TestNetworkClient::session() {
+  MockServer server;
+  server.setPassword("test");
+  QVERIFY(server.listen(0));
+
+  QObject owner;
+  NetworkClient *client = TestSupport::simulatedClient(&server, 1, &owner);
+
+  QSignalSpy requests(client,
+                      SIGNAL(requestFinished(QString, qint64, bool)));
+  QSignalSpy loginSucceeded(client,
+                            SIGNAL(loginSucceeded(QString, QString, int, int)));
+  QSignalSpy loginFailed(client, SIGNAL(loginFailed(QString)));
+  QSignalSpy timeUpdated(client, SIGNAL(timeUpdatedFromServer(int)));
+  QSignalSpy logoutSucceeded(client, SIGNAL(logoutSucceeded()));
+  QSignalSpy logoutFailed(client, SIGNAL(logoutFailed()));
+
+  QElapsedTimer step;
+  int failed = 0;
+
+  step.start();
+  client->start();
+  QVERIFY(TestSupport::waitForRequests(
+      &requests, QStringList() << "register_node", STEP_TIMEOUT, &failed));
+  QVERIFY2(step.elapsed() <= STEP_BUDGET, "register node over budget");
+
+  step.start();
+  client->attemptLogin("test", "wrong");
+  QVERIFY(loginFailed.wait(STEP_TIMEOUT));
+  QVERIFY2(step.elapsed() <= STEP_BUDGET, "rejected login over budget");
+  QCOMPARE(loginSucceeded.count(), 0);
+
+  step.start();
+  client->attemptLogin("test", "test");
+  QVERIFY(loginSucceeded.wait(STEP_TIMEOUT));
+  QVERIFY2(step.elapsed() <= STEP_BUDGET, "login over budget");
+  QCOMPARE(loginFailed.count(), 1);
+
+  step.start();
+  client->getUserDataUpdate();
+  QVERIFY(timeUpdated.wait(STEP_TIMEOUT));
+  QVERIFY2(step.elapsed() <= STEP_BUDGET, "user data update over budget");
+
+  step.start();
+  client->simulatePrintJob(PRINT_JOB_BYTES);
+  QVERIFY(TestSupport::waitForRequests(&requests, QStringList() << "print",
+                                       STEP_TIMEOUT, &failed));
+  QVERIFY2(step.elapsed() <= STEP_BUDGET, "print job over budget");
+
+  step.start();
+  client->acknowledgeReservation("test");
+  QVERIFY(TestSupport::waitForRequests(
+      &requests, QStringList() << "acknowledge_reservation", STEP_TIMEOUT,
+      &failed));
+  QVERIFY2(step.elapsed() <= STEP_BUDGET, "reservation over budget");
+
+  step.start();
+  client->attemptLogout();
+  QVERIFY(logoutSucceeded.wait(STEP_TIMEOUT));
+  QVERIFY2(step.elapsed() <= STEP_BUDGET, "logout over budget");
+  QCOMPARE(logoutFailed.count(), 0);
+
+  QCOMPARE(failed, 0);
+
+  // The periodic jobs may add a registration or update of their own
+  QVERIFY(server.requestCount("register_node") >= 1);
+  QVERIFY(server.requestCount("register_node") <= 2);
+  QCOMPARE(server.requestCount("login"), 2);
+  QVERIFY(server.requestCount("get_user_data") >= 1);
+  QVERIFY(server.requestCount("get_user_data") <= 2);
+  QCOMPARE(server.requestCount("print"), 1);
+  QCOMPARE(server.requestCount("acknowledge_reservation"), 1);
+  QCOMPARE(server.requestCount("logout"), 1);
+  QCOMPARE(server.requestCount("unknown"), 0);
+}
+
+/* A session that was locked when the client went down can't be unlocked
+ * again when the checkpoint holds no password, it is logged out instead of
+ * resumed behind a lock screen that opens with an empty entry. */
+void TestNetworkClient::lockedResumeWithoutPassword() {
+  QSettings settings;
+  settings.setValue("node/no_passwords", "0");
+  settings.setValue("session/EnableClientPasswordlessMode", "0");
+
+  MockServer server;
+  server.setPassword("test");
+  QVERIFY(server.listen(0));
+
+  QObject owner;
+  NetworkClient *patron = TestSupport::simulatedClient(&server, 1, &owner);
+  QSignalSpy loggedIn(patron,
+                      SIGNAL(loginSucceeded(QString, QString, int, int)));
+  patron->start();
+  patron->attemptLogin("locked", "test");
+  QVERIFY(loggedIn.wait(STEP_TIMEOUT));
+
+  SessionCheckpoint checkpoint;
+  checkpoint.username = "locked";
+  checkpoint.token = "token";
+  checkpoint.secondsRemaining = 3600;
+  checkpoint.locked = true;
+  QVERIFY(checkpoint.save());
+
+  NetworkClient *client = TestSupport::simulatedClient(&server, 2, &owner);
+  QSignalSpy requests(client,
+                      SIGNAL(requestFinished(QString, qint64, bool)));
+  QSignalSpy loginSucceeded(client,
+                            SIGNAL(loginSucceeded(QString, QString, int, int)));
+  QSignalSpy lockRestored(client, SIGNAL(sessionLockRestored()));
+
+  client->start();
+  QMetaObject::invokeMethod(client, "resumeSession", Qt::DirectConnection);
+  QVERIFY(TestSupport::waitForRequests(
+      &requests, QStringList() << "get_user_data" << "logout", STEP_TIMEOUT));
+
+  QCOMPARE(lockRestored.count(), 0);
+  QCOMPARE(loginSucceeded.count(), 0);
+  QCOMPARE(server.requestCount("logout"), 1);
+  QVERIFY(!SessionCheckpoint::load().isValid());
+}
+
+/* Simulated nodes ride out an outage of the server: print jobs sent into it
+ * are retried with a backoff, not hammered, and all reach the server once
+ * it is back. */
+void TestNetworkClient::recovery() {
+  MockServer server;
+  QVERIFY(server.listen(0));
+
+  // Every client gets an injector, without faults for now
+  FaultInjector::setRules(QHash<QString, FaultRule>());
+
+  QObject owner;
+  QList<NetworkClient *> clients;
+  QList<QSignalSpy *> requests;
+  for (int i = 0; i < RECOVERY_NODES; i++) {
+    NetworkClient *client =
+        TestSupport::simulatedClient(&server, i + 1, &owner);
+    clients << client;
+    requests << new QSignalSpy(client,
+                               SIGNAL(requestFinished(QString, qint64, bool)));
+
+    client->start();
+    client->attemptLogin(QString("recovery%1").arg(i + 1), "recovery");
+  }
+
+  int failed = 0;
+  for (int i = 0; i < clients.size(); i++) {
+    QVERIFY(TestSupport::waitForRequests(
+        requests.at(i), QStringList() << "login", STEP_TIMEOUT, &failed));
+  }
+  QCOMPARE(failed, 0);
+
+  FaultInjector::setRules(FaultInjector::parseRules(OUTAGE_FAULTS));
+  foreach (NetworkClient *client, clients) {
+    client->simulatePrintJob(PRINT_JOB_BYTES);
+  }
+  QTest::qWait(1000 * OUTAGE_SECONDS);
+  FaultInjector::setRules(QHash<QString, FaultRule>());
+
+  QCOMPARE(server.requestCount("print"), 0);
+  foreach (QSignalSpy *spy, requests) {
+    int attempts = 0;
+    for (int i = 0; i < spy->count(); i++) {
+      if (spy->at(i).at(0).toString() == "print") attempts++;
+    }
+    QVERIFY2(attempts >= 1 && attempts <= OUTAGE_PRINT_ATTEMPTS,
+             qPrintable(QString("%1 print attempts").arg(attempts)));
+  }
+
+  QTRY_COMPARE_WITH_TIMEOUT(server.requestCount("print"), clients.size(),
+                            1000 * RECOVERY_TIMEOUT);
+
+  // A job that got through isn't sent again
+  QTest::qWait(1000 * OUTAGE_SECONDS);
+  QCOMPARE(server.requestCount("print"), clients.size());
+
+  qDeleteAll(requests);
+}
+
+/* A client runs simulated days of sessions (login, heartbeats, a print job,
+ * logout) without a restart. Compared to the end of the first day, neither
+ * the resident memory nor the objects under the client nor the open files
+ * may keep growing. */
+void TestNetworkClient::soak() {
+  int days = qMax(qEnvironmentVariableIntValue("LIBKI_SOAK_DAYS"), 0);
+  if (!days) days = SOAK_DAYS;
+  days = qMax(days, 2);
+
+  MockServer server;
+  QVERIFY(server.listen(0));
+
+  QObject owner;
+  NetworkClient *client = TestSupport::simulatedClient(&server, 1, &owner);
+  QSignalSpy requests(client,
+                      SIGNAL(requestFinished(QString, qint64, bool)));
+
+  int failed = 0;
+  client->start();
+  QVERIFY(TestSupport::waitForRequests(
+      &requests, QStringList() << "register_node", STEP_TIMEOUT, &failed));
+
+  QList<SoakSample> samples;
+  for (int day = 1; day <= days; day++) {
+    for (int session = 1; session <= SOAK_SESSIONS_PER_DAY; session++) {
+      client->attemptLogin(QString("soak%1").arg(session % 10), "soak");
+      QVERIFY(TestSupport::waitForRequests(
+          &requests, QStringList() << "login", STEP_TIMEOUT, &failed));
+
+      for (int i = 0; i < SOAK_HEARTBEATS_PER_SESSION; i++) {
+        client->getUserDataUpdate();
+        QMetaObject::invokeMethod(client, "registerNode",
+                                  Qt::DirectConnection);
+        QVERIFY(TestSupport::waitForRequests(
+            &requests, QStringList() << "get_user_data" << "register_node",
+            STEP_TIMEOUT, &failed));
+      }
+
+      client->simulatePrintJob(SOAK_PRINT_JOB_BYTES);
+      QVERIFY(TestSupport::waitForRequests(
+          &requests, QStringList() << "print", STEP_TIMEOUT, &failed));
+
+      client->attemptLogout();
+      QVERIFY(TestSupport::waitForRequests(
+          &requests, QStringList() << "logout", STEP_TIMEOUT, &failed));
+    }
+
+    samples << soakSample(&owner);
+    qDebug() << "Soak day" << day << "RSS" << samples.last().rss
+             << "kB, QObjects" << samples.last().objects << ", open files"
+             << samples.last().descriptors;
+  }
+  QCOMPARE(failed, 0);
+
+  const SoakSample &warm = samples.first();
+  const SoakSample &last = samples.last();
+  QVERIFY2(last.objects - warm.objects <= SOAK_OBJECT_BUDGET,
+           qPrintable(QString("%1 more QObjects after the first day")
+                          .arg(last.objects - warm.objects)));
+  if (warm.descriptors >= 0 && last.descriptors >= 0) {
+    QVERIFY2(last.descriptors - warm.descriptors <= SOAK_DESCRIPTOR_BUDGET,
+             qPrintable(QString("%1 more open files after the first day")
+                            .arg(last.descriptors - warm.descriptors)));
+  }
+  if (warm.rss >= 0 && last.rss >= 0) {
+    QVERIFY2(last.rss - warm.rss <= SOAK_RSS_BUDGET,
+             qPrintable(QString("RSS grew %1 kB after the first day")
+                            .arg(last.rss - warm.rss)));
+  }
+}
+
+QTEST_MAIN(TestNetworkClient)
+#include "tst_networkclient.moc"
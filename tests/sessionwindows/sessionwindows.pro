@@ -0,0 +1,6 @@
+TEMPLATE = app
+TARGET = tst_sessionwindows
+
+include(../tests.pri)
+
+SOURCES += tst_sessionwindows.cpp
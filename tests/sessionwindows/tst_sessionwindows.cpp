@@ -0,0 +1,134 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QApplication>
+#include <QSettings>
+#include <QtTest>
+
+#include "perfutils.h"
+#include "sessionlockedwindow.h"
+#include "timerwindow.h"
+
+// Sessions of the day, every fourth one is locked and unlocked
+#define LOGINS 100
+#define LOCK_EVERY 4
+// Milliseconds between the steps of a session, enough for the windows to
+// paint
+#define STEP_DELAY 20
+// Sessions before the memory is considered warmed up
+#define WARM_UP_LOGINS 10
+// Kilobytes the resident memory may grow over the sessions after warm-up
+#define RSS_BUDGET 2048
+
+/* The session windows over a day of logins */
+class TestSessionWindows : public QObject {
+  Q_OBJECT
+
+ private slots:
+
+  void dayOfLogins();
+  void emptyEntryWithoutPassword();
+
+ private:
+  void settle();
+  int sessionLockedWindows();
+};
+
+/* Lets the windows paint and runs the deferred deletes of the last step */
+void TestSessionWindows::settle() {
+  QTest::qWait(STEP_DELAY);
+  QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+}
+
+int TestSessionWindows::sessionLockedWindows() {
+  int windows = 0;
+  foreach (QWidget *widget, QApplication::topLevelWidgets()) {
+    if (qobject_cast<SessionLockedWindow *>(widget)) windows++;
+  }
+  return windows;
+}
+
+/* Logs a patron in and out of a TimerWindow all day. The lock screen must be
+ * built once and reused, and neither the top level widgets nor the resident
+ * memory may pile up once the windows are warmed up. */
+void TestSessionWindows::dayOfLogins() {
+  TimerWindow timerWindow;
+
+  int warmWidgets = 0;
+  qint64 warmRss = 0;
+
+  for (int session = 1; session <= LOGINS; session++) {
+    timerWindow.startTimer(QString("test%1").arg(session), "test", 60, 0);
+    settle();
+
+    if (session % LOCK_EVERY == 0) {
+      timerWindow.lockSession();
+      settle();
+      QCOMPARE(sessionLockedWindows(), 1);
+
+      timerWindow.unlockSession();
+      settle();
+    }
+
+    timerWindow.stopTimer();
+    settle();
+
+    if (session == WARM_UP_LOGINS) {
+      warmWidgets = QApplication::topLevelWidgets().size();
+      warmRss = PerfUtils::residentSetSize();
+    }
+  }
+
+  QCOMPARE(sessionLockedWindows(), 1);
+  QCOMPARE(QApplication::topLevelWidgets().size(), warmWidgets);
+
+  qint64 rss = PerfUtils::residentSetSize();
+  if (warmRss < 0 || rss < 0) {
+    QSKIP("The resident memory can't be read on this platform");
+  }
+  QVERIFY2(rss - warmRss <= RSS_BUDGET,
+           qPrintable(QString("RSS grew %1 kB over %2 sessions")
+                          .arg(rss - warmRss)
+                          .arg(LOGINS - WARM_UP_LOGINS)));
+}
+
+/* A lock screen that doesn't know the patron's password, as after resuming
+ * a session from a checkpoint without one, must not open on an empty entry
+ * unless patrons log in without passwords */
+void TestSessionWindows::emptyEntryWithoutPassword() {
+  QSettings settings;
+  settings.setValue("node/no_passwords", "0");
+  settings.setValue("session/EnableClientPasswordlessMode", "0");
+
+  SessionLockedWindow window;
+  QSignalSpy unlocked(&window, SIGNAL(unlockSession()));
+  window.setCredentials("locked", QString());
+
+  window.passwordField->clear();
+  window.resumeButton->click();
+  QCOMPARE(unlocked.count(), 0);
+
+  settings.setValue("node/no_passwords", "1");
+  window.passwordField->clear();
+  window.resumeButton->click();
+  QCOMPARE(unlocked.count(), 1);
+
+  settings.remove("node/no_passwords");
+}
+
+QTEST_MAIN(TestSessionWindows)
+#include "tst_sessionwindows.moc"
@@ -0,0 +1,12 @@
+# Included by every test program: the client's sources with the developer
+# tools (the mock server, the fault injector) and the test support
+
+QT += testlib
+CONFIG += testcase console devtools
+CONFIG -= app_bundle
+
+include(../libki.pri)
+
+INCLUDEPATH += $$PWD
+HEADERS += $$PWD/testsupport.h
+SOURCES += $$PWD/testsupport.cpp
@@ -0,0 +1,8 @@
+# The client's QtTest suite, "make check" in the top level build runs it.
+# Every test program runs on the offscreen platform unless QT_QPA_PLATFORM
+# says otherwise, and without the client's debug trace unless
+# QT_LOGGING_RULES asks for it.
+TEMPLATE = subdirs
+SUBDIRS = networkclient \
+    sessionwindows \
+    timerwindow
@@ -0,0 +1,82 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsupport.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QUrl>
+
+#include "mockserver.h"
+#include "networkclient.h"
+
+// Runs before QTEST_MAIN creates the application
+static void setUpEnvironment() {
+  if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+  if (!qEnvironmentVariableIsSet("QT_LOGGING_RULES")) {
+    qputenv("QT_LOGGING_RULES", "default.debug=false");
+  }
+
+  // Checkpoints and caches must not clobber a kiosk's on a developer machine
+  QCoreApplication::setOrganizationName("Libki");
+  QCoreApplication::setOrganizationDomain("libki.org");
+  QCoreApplication::setApplicationName("Libki Tests");
+  QSettings::setDefaultFormat(QSettings::IniFormat);
+  QStandardPaths::setTestModeEnabled(true);
+}
+Q_CONSTRUCTOR_FUNCTION(setUpEnvironment)
+
+namespace TestSupport {
+
+NetworkClient *simulatedClient(MockServer *server, int number,
+                               QObject *parent) {
+  NetworkClient *client = new NetworkClient();
+  client->setParent(parent);
+  client->simulateNode(
+      QString("test-%1").arg(number), QString("10.0.0.%1").arg(number % 250 + 1),
+      QString("02:00:00:00:00:%1").arg(number % 256, 2, 16, QChar('0')),
+      QUrl(QString("http://127.0.0.1:%1").arg(server->port())));
+  return client;
+}
+
+bool waitForRequests(QSignalSpy *spy, QStringList actions, int timeoutMsecs,
+                     int *failed) {
+  QElapsedTimer timer;
+  timer.start();
+
+  forever {
+    // The client's own periodic requests are taken off as well
+    while (!spy->isEmpty()) {
+      QList<QVariant> arguments = spy->takeFirst();
+      if (actions.removeOne(arguments.at(0).toString()) &&
+          !arguments.at(2).toBool() && failed) {
+        (*failed)++;
+      }
+    }
+    if (actions.isEmpty()) return true;
+
+    qint64 left = timeoutMsecs - timer.elapsed();
+    if (left <= 0) return false;
+    spy->wait(int(left));
+  }
+}
+
+}  // namespace TestSupport
@@ -0,0 +1,48 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TESTSUPPORT_H
+#define TESTSUPPORT_H
+
+#include <QObject>
+#include <QSignalSpy>
+#include <QStringList>
+
+class MockServer;
+class NetworkClient;
+
+/* What the test programs share. Linking it in also makes them run on the
+ * offscreen platform and without the client's debug trace, unless
+ * QT_QPA_PLATFORM or QT_LOGGING_RULES are set, and keeps their settings and
+ * data apart from an installed client's. */
+namespace TestSupport {
+
+// A simulated node talking to the server, the number makes its name and
+// addresses unique
+NetworkClient *simulatedClient(MockServer *server, int number,
+                               QObject *parent);
+
+// Waits for the client to finish a request for each of the actions (an
+// action listed twice is waited for twice), taking the requests off the
+// spy of its requestFinished(). Requests that failed are added to failed.
+// False when they didn't all finish within the timeout.
+bool waitForRequests(QSignalSpy *spy, QStringList actions, int timeoutMsecs,
+                     int *failed = 0);
+
+}  // namespace TestSupport
+
+#endif  // TESTSUPPORT_H
@@ -0,0 +1,6 @@
+TEMPLATE = app
+TARGET = tst_timerwindow
+
+include(../tests.pri)
+
+SOURCES += tst_timerwindow.cpp
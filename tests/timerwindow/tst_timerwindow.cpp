@@ -0,0 +1,82 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QSettings>
+#include <QtTest>
+
+#include "timerwindow.h"
+
+#define SESSION_MINUTES 600
+
+/* What a clock update costs with the time shown in the tray and the splash.
+ * updateTimeLeft() redraws the clock once per call. */
+class TestTimerWindow : public QObject {
+  Q_OBJECT
+
+ private slots:
+
+  void initTestCase();
+  void cleanupTestCase();
+
+  void updateClockCached();
+  void updateClockUncached();
+
+ private:
+  TimerWindow *timerWindow;
+};
+
+void TestTimerWindow::initTestCase() {
+  QSettings settings;
+  settings.setValue("node/showTimeRemainingInTray", 1);
+  settings.setValue("node/showTimeRemainingInSplash", 1);
+
+  timerWindow = new TimerWindow();
+  timerWindow->startTimer("test", "test", SESSION_MINUTES, 0);
+}
+
+void TestTimerWindow::cleanupTestCase() {
+  timerWindow->stopTimer();
+  delete timerWindow;
+
+  QSettings settings;
+  settings.remove("node/showTimeRemainingInTray");
+  settings.remove("node/showTimeRemainingInSplash");
+}
+
+/* The minute count doesn't change, after the first two updates both tray
+ * color phases and the splash come from the render cache */
+void TestTimerWindow::updateClockCached() {
+  timerWindow->updateTimeLeft(SESSION_MINUTES);
+  timerWindow->updateTimeLeft(SESSION_MINUTES);
+
+  QBENCHMARK { timerWindow->updateTimeLeft(SESSION_MINUTES); }
+}
+
+/* Every update shows another minute count, the tray icon and the splash are
+ * painted again */
+void TestTimerWindow::updateClockUncached() {
+  int minutes = SESSION_MINUTES;
+
+  QBENCHMARK {
+    // Counts down, then wraps far above the counts cached so far
+    if (--minutes <= 0) minutes = 100 * SESSION_MINUTES;
+    timerWindow->updateTimeLeft(minutes);
+  }
+}
+
+QTEST_MAIN(TestTimerWindow)
+#include "tst_timerwindow.moc"
@@ -25,23 +25,46 @@
 #include <QIcon>
 #include <QScreen>
 
+#include "idlemonitor.h"
+#include "perfutils.h"
+#include "processsupervisor.h"
+#include "scheduler.h"
 #include "sessionlockedwindow.h"
 #include "utils.h"
 #include "timesplash.h"
 
+// Idle time sampling interval when no system wide idle source is available
 #define INACTIVITY_CHECK_INTERVAL 10
+// How often the inactivity warning is repeated while the patron stays idle
+#define INACTIVITY_WARNING_INTERVAL 60
+// How often to look for inactivity settings when inactivity logout is off
+#define INACTIVITY_SETTINGS_INTERVAL 60
+#define RENDER_CACHE_SIZE 8
+// Default seconds between user data updates from the server
+#define SYNC_INTERVAL 30
+// Missed updates after which the countdown is shown as unsynced
+#define SYNC_STALE_UPDATES 3
 
 TimerWindow::TimerWindow(QWidget *parent) : QMainWindow(parent) {
   qDebug("ENTER TimerWindow::TimerWindow");
 
   setAllowClose(false);
 
+  sessionLockedWindow = Q_NULLPTR;
+  trayIcon = Q_NULLPTR;
+  timeSplash = Q_NULLPTR;
+
   setupUi(this);
 
   libkiIcon = QIcon(":/images/images/libki_clock.png");
 
   this->setWindowIcon(libkiIcon);
 
+  notifications = new NotificationCenter(this);
+  connect(notifications, SIGNAL(showing()), this, SLOT(restoreTimerWindow()));
+  connect(notifications, SIGNAL(acknowledged()), this,
+          SIGNAL(messagesAcknowledged()));
+
   // Prevent the window from being resized
   setFixedSize(width(), height());
 
@@ -54,18 +77,27 @@ TimerWindow::TimerWindow(QWidget *parent) : QMainWindow(parent) {
                  ~Qt::WindowSystemMenuHint);
 
   setupActions();
-  setupTrayIcon();
 
-  // Set up the timer splash
-  QPixmap pixmap(":/images/images/time_splash_background.png");
-  timeSplash = new TimeSplash( this, pixmap, Qt::WindowStaysOnTopHint );
+  swapColors = false;
+
+  idleMonitor = new IdleMonitor(this);
 
-  trayIconPopupTimer = new QTimer(this);
-  connect(trayIconPopupTimer, SIGNAL(timeout()), this,
-          SLOT(showSystemTrayIconTimeLeftMessage()));
+  // The time display counts down in seconds between server updates
+  lcdNumber->setDigitCount(7);
+  sessionClock.start();
+  lastSync.start();
+  syncInterval = SYNC_INTERVAL;
+  anchorSeconds = 0;
+  anchorMsecs = 0;
+  syncStale = false;
+  syncRequestedAtZero = false;
 
-  inactivityTimer = new QTimer(this);
-  connect(inactivityTimer, SIGNAL(timeout()), this, SLOT(checkForInactivity()));
+  Scheduler *scheduler = Scheduler::instance();
+  scheduler->addJob("showSystemTrayIconTimeLeftMessage", 1000 * 60, this,
+                    "showSystemTrayIconTimeLeftMessage");
+  scheduler->addJob("checkForInactivity", 1000 * INACTIVITY_CHECK_INTERVAL,
+                    this, "checkForInactivity");
+  scheduler->addJob("tickClock", 1000, this, "tickClock");
 
   this->move(QApplication::desktop()->screen()->rect().center() -
              this->rect().center());
@@ -84,28 +116,42 @@ void TimerWindow::startTimer(QString newUsername, QString newPassword,
   username = newUsername;
   password = newPassword;
 
-  sessionLockedWindow = new SessionLockedWindow(0, username, password);
-  connect(sessionLockedWindow, SIGNAL(unlockSession()), this,
-          SLOT(unlockSession()));
-  sessionLockedWindow->hide();
+  setupSessionWidgets();
 
-  trayIconPopupTimer->start(1000 * 60);  // Fire once a minute
+  Scheduler::instance()->start("showSystemTrayIconTimeLeftMessage");
 
-  secondsSinceLastActivity = 0;
-  inactivityTimer->start(1000 * INACTIVITY_CHECK_INTERVAL);
+  idleMonitor->reset();
+  Scheduler::instance()->startOnce("checkForInactivity",
+                                   1000 * INACTIVITY_CHECK_INTERVAL);
 
   this->show();
   trayIcon->show();
 
+  QSettings sessionSettings;
+  sessionSettings.setIniCodec("UTF-8");
+  syncInterval =
+      sessionSettings.value("node/syncInterval", SYNC_INTERVAL).toInt();
+
+  setSecondsRemaining(qint64(minutes) * 60);
+  lastSync.start();
+  syncStale = false;
+  syncRequestedAtZero = false;
+
   minutesRemaining = minutesAtStart = minutes;
   updateClock();
 
+  Scheduler::instance()->start("tickClock");
+
+  // Measured once the window had a chance to paint
+  QTimer::singleShot(0, this, SLOT(recordLoginLatency()));
+
   QSettings settings;
   settings.setIniCodec("UTF-8");
 
   if (settings.value("session/EnableClientSessionLocking").toBool()) {
+    // The window outlives the session, connect the button only once
     connect(lockSessionButton, SIGNAL(clicked(bool)), this,
-            SLOT(lockSession()));
+            SLOT(lockSession()), Qt::UniqueConnection);
   } else {
     lockSessionButton->hide();
   }
@@ -120,7 +166,8 @@ void TimerWindow::startTimer(QString newUsername, QString newPassword,
   }
 
   if (hold_items_count > 0) {
-    this->showMessage(waiting_holds_message);
+    // Not a server message, nothing to acknowledge
+    notifications->post(waiting_holds_message, false);
   }
 
   qDebug("LEAVE TimerWindow::startTimer");
@@ -129,19 +176,29 @@ void TimerWindow::startTimer(QString newUsername, QString newPassword,
 void TimerWindow::stopTimer() {
   qDebug("ENTER TimerWindow::stopTimer");
 
-  inactivityTimer->stop();
+  Scheduler::instance()->stop("checkForInactivity");
 
-  trayIconPopupTimer->stop();
-  trayIcon->hide();
+  Scheduler::instance()->stop("showSystemTrayIconTimeLeftMessage");
+  Scheduler::instance()->stop("tickClock");
+  if (trayIcon) trayIcon->hide();
   this->hide();
+  if (sessionLockedWindow) sessionLockedWindow->hide();
+
+  // Brings back the login screen, the rest can wait for it
+  emit timerStopped();
+
+  notifications->clear();
 
+  // The next session starts at another time
+  renderCache.clear();
+
+  // Kept for the next session, without this one's password
   if (sessionLockedWindow) {
-    sessionLockedWindow->hide();
-    delete sessionLockedWindow;
-    sessionLockedWindow = Q_NULLPTR;
+    sessionLockedWindow->setCredentials(QString(), QString());
   }
 
-  emit timerStopped();
+  username.clear();
+  password.clear();
 
   qDebug("LEAVE TimerWindow::stopTimer");
 }
@@ -149,6 +206,8 @@ void TimerWindow::stopTimer() {
 void TimerWindow::updateClock() {
   qDebug("ENTER TimerWindow::updateClock");
 
+  setupSessionWidgets();
+
   QSettings settings;
   settings.setIniCodec("UTF-8");
 
@@ -159,7 +218,7 @@ void TimerWindow::updateClock() {
   QString time = QString::number(hours) + ":" +
                  QString::number(minutes).rightJustified(2, '0');
 
-  lcdNumber->display(time);
+  updateCountdown();
 
   /* Update the progress bar */
   if (minutesRemaining > minutesAtStart) minutesAtStart = minutesRemaining;
@@ -174,63 +233,184 @@ void TimerWindow::updateClock() {
   this->setWindowTitle("Libki " + time);
 
   if ( settings.value("node/showTimeRemainingInTray").toInt() == 1 ) {
-      // Update the system tray icon
-      QPixmap libkiIcon = QPixmap(":/images/images/tray.png");
-      QPainter painter(&libkiIcon);
-      QFont font = painter.font() ;
-      font.setBold(true);
+      // Update the system tray icon, alternating the text color on each update
+      int pointSize = 9;
       if ( minutesRemaining < 10 ) {
-        font.setPointSize(14);
+        pointSize = 14;
       } else if ( minutesRemaining < 100 ) {
-        font.setPointSize(11);
-      } else {
-        font.setPointSize(9);
+        pointSize = 11;
       }
-      painter.setFont(font);
 
-      if ( this->swapColors ) {
-          painter.setPen(QColor(Qt::black));
-      } else {
-          painter.setPen(QColor(Qt::white));
-      }
+      QColor color = this->swapColors ? QColor(Qt::black) : QColor(Qt::white);
+      QString key = renderCacheKey("tray", trayBackground, this->swapColors);
       this->swapColors = !this->swapColors;
-      painter.drawText(libkiIcon.rect(), Qt::AlignCenter, minutesString);
 
-      trayIcon->setIcon(libkiIcon);
+      if ( key != trayIconKey ) {
+          trayIcon->setIcon(renderText(key, trayBackground, minutesString,
+                                       pointSize, color));
+          trayIconKey = key;
+      }
   }
 
   bool showSplash = settings.value("node/showTimeRemainingInSplash").toInt() == 1;
   if ( sessionLockedWindow && sessionLockedWindow->isVisible() ) showSplash = false;
   if ( showSplash ) {
-      // Update the time splash
-      QScreen* screen = QGuiApplication::screens()[0];
-      QRect screenrect = screen->availableGeometry();
-
-      QPixmap pixmap(":/images/images/time_splash_background.png");
-
-      QPainter painter(&pixmap);
-      QFont font = painter.font() ;
-      font.setBold(true);
-      font.setPointSize(30);
-      painter.setFont(font);
-      painter.drawText(pixmap.rect(), Qt::AlignCenter, minutesString);
-
-      timeSplash->setPixmap(pixmap);
-      timeSplash->move(screenrect.right() -  timeSplash->width(), screenrect.bottom() - timeSplash->height());
-      timeSplash->show();
-      timeSplash->raise(); // Some X11 window managers do not support the "stays on top" flag. A solution is to set up a timer that periodically calls raise() on the splash screen to simulate the "stays on top" effect.
+      QString key = renderCacheKey("splash", splashBackground, false);
+
+      // Only repaint the time splash if the displayed time has changed
+      if ( key != timeSplashKey || !timeSplash->isVisible() ) {
+          QScreen* screen = QGuiApplication::screens()[0];
+          QRect screenrect = screen->availableGeometry();
+
+          timeSplash->setPixmap(renderText(key, splashBackground, minutesString,
+                                           30, QColor(Qt::black)));
+          timeSplash->move(screenrect.right() -  timeSplash->width(), screenrect.bottom() - timeSplash->height());
+          timeSplash->show();
+          timeSplashKey = key;
 
-      QCoreApplication::processEvents();
+          QCoreApplication::processEvents();
+      }
+
+      timeSplash->raise(); // Some X11 window managers do not support the "stays on top" flag. A solution is to set up a timer that periodically calls raise() on the splash screen to simulate the "stays on top" effect.
   } else {
       timeSplash->hide();
+      timeSplashKey.clear();
   }
 
   qDebug("LEAVE TimerWindow::updateClock");
 }
 
+/* Render cache entries are keyed by the text shown, the color phase and the
+ * size of the background, so a tray blink or an unchanged minute count reuses
+ * an already painted pixmap. */
+QString TimerWindow::renderCacheKey(const QString &kind,
+                                    const QPixmap &background, bool phase) {
+  return QString("%1:%2:%3:%4x%5")
+      .arg(kind)
+      .arg(minutesRemaining)
+      .arg(phase ? 1 : 0)
+      .arg(background.width())
+      .arg(background.height());
+}
+
+QPixmap TimerWindow::renderText(const QString &key, const QPixmap &background,
+                                const QString &text, int pointSize,
+                                const QColor &color) {
+  if (renderCache.contains(key)) {
+    return renderCache.value(key);
+  }
+
+  // Only the current and the previous minute are ever displayed again
+  if (renderCache.size() >= RENDER_CACHE_SIZE) {
+    renderCache.clear();
+  }
+
+  QPixmap pixmap = background;
+  QPainter painter(&pixmap);
+  QFont font = painter.font();
+  font.setBold(true);
+  font.setPointSize(pointSize);
+  painter.setFont(font);
+  painter.setPen(color);
+  painter.drawText(pixmap.rect(), Qt::AlignCenter, text);
+  painter.end();
+
+  renderCache.insert(key, pixmap);
+
+  return pixmap;
+}
+
+/* Shows the seconds resolution countdown and whether it is still backed by
+ * recent server updates, called every second */
+void TimerWindow::updateCountdown() {
+  qint64 seconds = secondsRemaining();
+
+  QString time = QString("%1:%2:%3")
+                     .arg(seconds / 3600)
+                     .arg((seconds / 60) % 60, 2, 10, QChar('0'))
+                     .arg(seconds % 60, 2, 10, QChar('0'));
+  // Sessions of ten hours or more need another digit
+  if (lcdNumber->digitCount() != time.length()) {
+    lcdNumber->setDigitCount(time.length());
+  }
+  lcdNumber->display(time);
+
+  bool stale = lastSync.elapsed() > 1000 * syncInterval * SYNC_STALE_UPDATES;
+  if (stale != syncStale || syncLabel->text().isEmpty()) {
+    syncStale = stale;
+    if (syncStale) {
+      syncLabel->setText(tr("Not connected, time is estimated"));
+      syncLabel->setStyleSheet("color: red;");
+    } else {
+      syncLabel->setText(tr("Synchronized"));
+      syncLabel->setStyleSheet("");
+    }
+  }
+}
+
+qint64 TimerWindow::secondsRemaining() const {
+  qint64 elapsed = (sessionClock.elapsed() - anchorMsecs) / 1000;
+  return qMax(qint64(0), anchorSeconds - elapsed);
+}
+
+void TimerWindow::setSecondsRemaining(qint64 seconds) {
+  anchorSeconds = qMax(qint64(0), seconds);
+  anchorMsecs = sessionClock.elapsed();
+}
+
+void TimerWindow::tickClock() {
+  qint64 seconds = secondsRemaining();
+
+  // Only the minute based parts of the display need repainting on the minute
+  int minutes = int((seconds + 59) / 60);
+  if (minutes != minutesRemaining) {
+    minutesRemaining = minutes;
+    updateClock();
+  } else {
+    updateCountdown();
+  }
+
+  // The server decides when the session is over, ask it right away instead
+  // of waiting for the next update
+  if (seconds == 0 && !syncRequestedAtZero) {
+    syncRequestedAtZero = true;
+    emit syncRequested();
+  }
+}
+
+void TimerWindow::recordLoginLatency() {
+  qint64 msecs = PerfUtils::endInterval("login");
+  if (msecs >= 0) {
+    PerfUtils::recordHistogram("login", msecs);
+  }
+}
+
 void TimerWindow::updateTimeLeft(int minutes) {
   qDebug() << QString("ENTER TimerWindow::updateTimeLeft(%1)").arg(minutes);
 
+  /* The server counts in whole minutes, N minutes left means somewhere in
+   * ((N - 1) * 60, N * 60] seconds. Keep the local countdown while it agrees,
+   * pull it back to the nearest edge when it drifted out, and start over when
+   * time was added or removed on the server. */
+  qint64 local = secondsRemaining();
+  qint64 upper = qMax(qint64(0), qint64(minutes) * 60);
+  qint64 lower = qMax(qint64(0), upper - 59);
+
+  qint64 corrected = local;
+  if (local > upper) {
+    corrected = upper;
+  } else if (local < lower) {
+    corrected = lower - local < 60 ? lower : upper;
+  }
+
+  if (corrected != local) {
+    qDebug() << "COUNTDOWN DRIFT: " << corrected - local << " seconds";
+    setSecondsRemaining(corrected);
+  }
+
+  lastSync.restart();
+  syncRequestedAtZero = false;
+
   minutesRemaining = minutes;
   updateClock();
 
@@ -279,6 +459,25 @@ void TimerWindow::setupActions() {
   qDebug("LEAVE TimerWindow::setupActions");
 }
 
+/* The tray icon and the time splash are only needed once a patron logs in */
+void TimerWindow::setupSessionWidgets() {
+  if (trayIcon) return;
+
+  qDebug("ENTER TimerWindow::setupSessionWidgets");
+
+  setupTrayIcon();
+
+  // Load the backgrounds used for the time display once, they are copied for
+  // each newly rendered minute
+  trayBackground = QPixmap(":/images/images/tray.png");
+  splashBackground = QPixmap(":/images/images/time_splash_background.png");
+
+  // Set up the timer splash
+  timeSplash = new TimeSplash( this, splashBackground, Qt::WindowStaysOnTopHint );
+
+  qDebug("LEAVE TimerWindow::setupSessionWidgets");
+}
+
 void TimerWindow::setupTrayIcon() {
   qDebug("ENTER TimerWindow::setupTrayIcon");
 
@@ -401,20 +600,12 @@ void TimerWindow::checkForInactivity() {
 
   qDebug() << "INACTIVIY WARNING: " << inactivityWarning;
 
+  int nextCheck = INACTIVITY_CHECK_INTERVAL;
+
   if (inactivityLogout > 0) {
-    QPoint pos = QCursor::pos();
-    int x = pos.x();
-    int y = pos.y();
-
-    // TODO: Implement ranges to account for mouse wobble?
-    if (prevMousePosX == x && prevMousePosY == y) {
-      secondsSinceLastActivity += INACTIVITY_CHECK_INTERVAL;
-      qDebug() << "No activity detected. Seconds since last activity: "
-               << secondsSinceLastActivity;
-    } else {
-      secondsSinceLastActivity = 0;
-      qDebug() << "Activity detected. Seconds since last activity: 0";
-    }
+    int secondsSinceLastActivity = idleMonitor->idleMsecs() / 1000;
+    qDebug() << "Seconds since last activity: " << secondsSinceLastActivity
+             << " (" << idleMonitor->sourceName() << ")";
 
     if (secondsSinceLastActivity / 60 >= inactivityWarning) {
       QString title = tr("Inactivity detected");
@@ -436,28 +627,43 @@ void TimerWindow::checkForInactivity() {
       trayIcon->showMessage(title, message, QSystemTrayIcon::Critical, 100000);
     }
 
-    if (secondsSinceLastActivity / 60 >= inactivityLogout) {
+    bool loggingOut = secondsSinceLastActivity / 60 >= inactivityLogout;
+    if (loggingOut) {
       emit requestLogout();
     }
 
-    prevMousePosX = x;
-    prevMousePosY = y;
+    // A system wide idle source doesn't need sampling, sleep until the next
+    // threshold could be crossed. Any activity in between pushes it back.
+    // Once the logout is requested the regular interval is enough to repeat
+    // it should it fail.
+    if (idleMonitor->isPrecise() && !loggingOut) {
+      int warningAt = inactivityWarning * 60;
+      int logoutAt = inactivityLogout * 60;
+
+      if (secondsSinceLastActivity < warningAt && warningAt < logoutAt) {
+        nextCheck = warningAt - secondsSinceLastActivity;
+      } else {
+        nextCheck = qMin(logoutAt - secondsSinceLastActivity,
+                         INACTIVITY_WARNING_INTERVAL);
+      }
+      nextCheck = qMax(nextCheck, 1);
+    }
+  } else {
+    // The server may still enable inactivity logout during the session
+    nextCheck = INACTIVITY_SETTINGS_INTERVAL;
   }
 
+  qDebug() << "Next inactivity check in " << nextCheck << " seconds";
+  Scheduler::instance()->startOnce("checkForInactivity", 1000 * nextCheck);
+
   qDebug("LEAVE TimerWindow::checkForInactivity");
 }
 
 void TimerWindow::showMessage(QString message) {
   qDebug() << QString("ENTER TimerWindow::showMessage(%1)").arg(message);
 
-  QMessageBox msgBox;
-  msgBox.setWindowIcon(libkiIcon);
-  msgBox.setIcon(QMessageBox::Information);
-  msgBox.setText(tr("You have a message"));
-  msgBox.setInformativeText(message);
-
-  this->restoreTimerWindow();
-  msgBox.exec();
+  // A modal box would run a nested event loop the next message re-enters
+  notifications->post(message);
 
   qDebug() << QString("LEAVE TimerWindow::showMessage(%1)").arg(message);
 }
@@ -465,10 +671,30 @@ void TimerWindow::showMessage(QString message) {
 void TimerWindow::lockSession() {
   qDebug("ENTER TimerWindow::lockSession()");
 
-  QProcess::startDetached("windows/on_startup.exe");
+#ifdef Q_OS_WIN
+  ProcessSupervisor::instance()->detach("on_startup",
+                                        "windows/on_startup.exe");
+#endif  // ifdef Q_OS_WIN
   this->hide();
-  timeSplash->hide();
-  sessionLockedWindow->show();
+  if (timeSplash) timeSplash->hide();
+
+  // Most sessions are never locked, the window is built on the first lock
+  // and reused afterwards
+  if (!sessionLockedWindow) {
+    QElapsedTimer constructionTimer;
+    constructionTimer.start();
+
+    sessionLockedWindow = new SessionLockedWindow();
+    connect(sessionLockedWindow, SIGNAL(unlockSession()), this,
+            SLOT(unlockSession()));
+
+    PerfUtils::recordDuration("SessionLockedWindow construction",
+                              constructionTimer.nsecsElapsed());
+  }
+  sessionLockedWindow->setCredentials(username, password);
+  sessionLockedWindow->showMe();
+
+  emit sessionLockChanged(true);
 
   qDebug("LEAVE TimerWindow::lockSession()");
 }
@@ -476,11 +702,15 @@ void TimerWindow::lockSession() {
 void TimerWindow::unlockSession() {
   qDebug("ENTER TimerWindow::unlockSession");
 
-  QProcess::startDetached("windows/on_login.exe");
+#ifdef Q_OS_WIN
+  ProcessSupervisor::instance()->run("on_login", "windows/on_login.exe");
+#endif  // ifdef Q_OS_WIN
 
-  sessionLockedWindow->hide();
+  if (sessionLockedWindow) sessionLockedWindow->hide();
   this->show();
 
+  emit sessionLockChanged(false);
+
   qDebug("LEAVE TimerWindow::unlockSession");
 }
 
@@ -20,6 +20,7 @@
 #ifndef TIMERWINDOW_H
 #define LOGINWINDOW_H
 
+#include <QElapsedTimer>
 #include <QMainWindow>
 #include <QMessageBox>
 #include <QSettings>
@@ -28,7 +29,9 @@
 #include <QtDebug>
 #include <QtGui>
 
+#include "idlemonitor.h"
 #include "networkclient.h"
+#include "notificationcenter.h"
 #include "sessionlockedwindow.h"
 #include "ui_timerwindow.h"
 #include "timesplash.h"
@@ -46,6 +49,9 @@ class TimerWindow : public QMainWindow, public Ui::TimerWindow {
   void requestLogout();
   void timerStopped();
   void serverAccountMinutesRequest();
+  void syncRequested();
+  void sessionLockChanged(bool locked);
+  void messagesAcknowledged();
 
  public slots:
 
@@ -65,6 +71,8 @@ class TimerWindow : public QMainWindow, public Ui::TimerWindow {
   void iconActivated(QSystemTrayIcon::ActivationReason);
   void showSystemTrayIconTimeLeftMessage();
   void checkForInactivity();
+  void tickClock();
+  void recordLoginLatency();
 
  private:
   SessionLockedWindow *sessionLockedWindow;
@@ -74,28 +82,48 @@ class TimerWindow : public QMainWindow, public Ui::TimerWindow {
   bool allowClose;
 
   QIcon libkiIcon;
+  NotificationCenter *notifications;
   QSystemTrayIcon *trayIcon;
   QMenu *trayIconMenu;
   TimeSplash *timeSplash;
 
-  QTimer *trayIconPopupTimer;
-  QTimer *inactivityTimer;
   int minutesRemaining;
   int minutesAtStart;
 
-  int secondsSinceLastActivity;
-  int prevMousePosX;
-  int prevMousePosY;
+  // The countdown runs locally from the last time reported by the server
+  QElapsedTimer sessionClock;
+  qint64 anchorSeconds;
+  qint64 anchorMsecs;
+  QElapsedTimer lastSync;
+  int syncInterval;
+  bool syncStale;
+  bool syncRequestedAtZero;
+
+  IdleMonitor *idleMonitor;
 
   bool swapColors;
 
+  QPixmap trayBackground;
+  QPixmap splashBackground;
+  QHash<QString, QPixmap> renderCache;
+  QString trayIconKey;
+  QString timeSplashKey;
+
   void setupActions();
 
   void setupTrayIcon();
+  void setupSessionWidgets();
 
   void getSettings();
 
   void updateClock();
+  void updateCountdown();
+  qint64 secondsRemaining() const;
+  void setSecondsRemaining(qint64 seconds);
+  QString renderCacheKey(const QString &kind, const QPixmap &background,
+                         bool phase);
+  QPixmap renderText(const QString &key, const QPixmap &background,
+                     const QString &text, int pointSize, const QColor &color);
 };
 
 #endif  // LOGINWINDOW_H
@@ -0,0 +1,156 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tlssessioncache.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+
+TlsSessionCache::TlsSessionCache(const QString &host, int port)
+    : host(host), port(port) {
+  qDebug("ENTER TlsSessionCache::TlsSessionCache");
+
+  QSettings settings;
+  settings.setIniCodec("UTF-8");
+  QString configured =
+      settings.value("server/certificate_fingerprint").toString();
+  if (!configured.isEmpty()) {
+    pin = configured.toLower().remove(':');
+  }
+
+  load();
+
+  qDebug("LEAVE TlsSessionCache::TlsSessionCache");
+}
+
+QString TlsSessionCache::fingerprint(const QSslCertificate &certificate) {
+  return QString::fromLatin1(
+      certificate.digest(QCryptographicHash::Sha256).toHex());
+}
+
+bool TlsSessionCache::hasTicket() const { return !ticket.isEmpty(); }
+
+QSslConfiguration TlsSessionCache::configuration() const {
+  QSslConfiguration configuration = QSslConfiguration::defaultConfiguration();
+#if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
+  configuration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+  if (!ticket.isEmpty()) {
+    configuration.setSessionTicket(ticket);
+  }
+#endif  // if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
+  return configuration;
+}
+
+void TlsSessionCache::update(QNetworkReply *reply) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
+  if (reply->error() != QNetworkReply::NoError) return;
+
+  QSslConfiguration configuration = reply->sslConfiguration();
+  QByteArray newTicket = configuration.sessionTicket();
+  if (newTicket.isEmpty() || newTicket == ticket) return;
+
+  QString peer = fingerprint(configuration.peerCertificate());
+  if (!pin.isEmpty() && peer != pin) {
+    qDebug() << "TLS: not saving session ticket for unpinned certificate "
+             << peer;
+    return;
+  }
+
+  qDebug("ENTER TlsSessionCache::update");
+
+  ticketFingerprint = peer;
+  ticket = newTicket;
+  save();
+
+  qDebug("LEAVE TlsSessionCache::update");
+#else
+  Q_UNUSED(reply);
+#endif  // if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
+}
+
+bool TlsSessionCache::acceptErrors(QNetworkReply *reply,
+                                   const QList<QSslError> &errors) {
+  QString peer = fingerprint(reply->sslConfiguration().peerCertificate());
+
+  foreach (const QSslError &error, errors) {
+    qDebug() << "TLS ERROR: " << error.errorString();
+  }
+
+  // Nothing pinned, a renewed self signed certificate must not cut the
+  // kiosks off
+  if (pin.isEmpty() || peer == pin) {
+    return true;
+  }
+
+  qDebug() << "TLS: certificate " << peer
+           << " does not match server/certificate_fingerprint " << pin;
+  return false;
+}
+
+void TlsSessionCache::load() {
+  QFile file(path());
+  if (!file.open(QIODevice::ReadOnly)) return;
+
+  QJsonObject object = QJsonDocument::fromJson(file.readAll()).object();
+  if (object["host"].toString() != host || object["port"].toInt() != port) {
+    qDebug("TLS: session cache belongs to another server, ignoring it");
+    return;
+  }
+
+  QString savedFingerprint = object["fingerprint"].toString();
+  if (!pin.isEmpty() && savedFingerprint != pin) {
+    qDebug("TLS: saved session doesn't match the configured fingerprint");
+    return;
+  }
+
+  ticketFingerprint = savedFingerprint;
+  ticket = QByteArray::fromBase64(object["ticket"].toString().toLatin1());
+
+  qDebug() << "TLS: loaded " << (ticket.isEmpty() ? "no" : "a")
+           << " session ticket for " << host;
+}
+
+void TlsSessionCache::save() {
+  QJsonObject object;
+  object["host"] = host;
+  object["port"] = port;
+  object["fingerprint"] = ticketFingerprint;
+  object["ticket"] = QString::fromLatin1(ticket.toBase64());
+
+  QDir().mkpath(QFileInfo(path()).absolutePath());
+
+  // The ticket is as good as the session keys, keep it to ourselves
+  QSaveFile file(path());
+  if (file.open(QIODevice::WriteOnly)) {
+    file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+    file.write(QJsonDocument(object).toJson(QJsonDocument::Compact));
+    file.commit();
+  }
+}
+
+QString TlsSessionCache::path() const {
+  return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) +
+         "/tls_session.json";
+}
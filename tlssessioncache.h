@@ -0,0 +1,69 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TLSSESSIONCACHE_H
+#define TLSSESSIONCACHE_H
+
+#include <QByteArray>
+#include <QList>
+#include <QSslCertificate>
+#include <QSslConfiguration>
+#include <QSslError>
+#include <QString>
+#include <QtNetwork/QNetworkReply>
+
+/* Keeps the TLS session ticket of the Libki server on disk, so the first
+ * requests after a reboot resume the previous session instead of doing a
+ * full handshake. The ticket is stored with the SHA-256 fingerprint of the
+ * server certificate it was issued with. When server/certificate_fingerprint
+ * is set, certificate errors (e.g. a self signed certificate) are only
+ * ignored for that certificate, otherwise they are ignored as they always
+ * were. Ticket reuse needs Qt 5.6. */
+class TlsSessionCache {
+ public:
+  TlsSessionCache(const QString &host, int port);
+
+  // The configuration requests to the server should use
+  QSslConfiguration configuration() const;
+
+  // Saves the ticket of a finished reply when it is new and the server
+  // presented the pinned certificate
+  void update(QNetworkReply *reply);
+
+  // True when the errors may be ignored, false when a certificate other
+  // than the configured one was presented
+  bool acceptErrors(QNetworkReply *reply, const QList<QSslError> &errors);
+
+  bool hasTicket() const;
+
+  static QString fingerprint(const QSslCertificate &certificate);
+
+ private:
+  QString host;
+  int port;
+
+  // server/certificate_fingerprint, empty when nothing is pinned
+  QString pin;
+  QString ticketFingerprint;
+  QByteArray ticket;
+
+  void load();
+  void save();
+  QString path() const;
+};
+
+#endif  // TLSSESSIONCACHE_H
@@ -0,0 +1,241 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trafficcapture.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QUuid>
+
+#define CAPTURE_MAGIC "LKCAP"
+#define CAPTURE_VERSION 1
+// Megabytes a capture may grow to before recording stops
+#define CAPTURE_MAX_MEGABYTES 50
+
+QDataStream &operator<<(QDataStream &stream, const TrafficRecord &record) {
+  stream << record.sent << record.duration << qint32(record.operation)
+         << record.action << record.url << qint32(record.status)
+         << qint32(record.error) << record.bytes << record.body;
+  return stream;
+}
+
+QDataStream &operator>>(QDataStream &stream, TrafficRecord &record) {
+  qint32 operation, status, error;
+  stream >> record.sent >> record.duration >> operation >> record.action >>
+      record.url >> status >> error >> record.bytes >> record.body;
+  record.operation = operation;
+  record.status = status;
+  record.error = error;
+  return stream;
+}
+
+TrafficCapture::TrafficCapture(const QString &path, const QString &nodeName,
+                               qint64 maxBytes)
+    : file(path), maxBytes(maxBytes) {
+  salt = QUuid::createUuid().toRfc4122();
+
+  QDir().mkpath(QFileInfo(path).absolutePath());
+
+  // Even redacted, the traffic says who used the kiosk and when
+  if (!file.open(QIODevice::WriteOnly)) {
+    qDebug() << "CAPTURE: unable to write " << path;
+    return;
+  }
+  file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+
+  stream.setDevice(&file);
+  stream.setVersion(QDataStream::Qt_5_5);
+  stream.writeRawData(CAPTURE_MAGIC, 5);
+  stream << quint32(CAPTURE_VERSION) << nodeName
+         << QDateTime::currentDateTimeUtc();
+  file.flush();
+
+  qDebug() << "CAPTURE: recording server traffic to " << path;
+}
+
+TrafficCapture *TrafficCapture::fromSettings(const QString &nodeName) {
+  QSettings settings;
+  settings.setIniCodec("UTF-8");
+
+  QString path = QString::fromLocal8Bit(qgetenv("LIBKI_CAPTURE"));
+  if (path.isEmpty() && settings.value("capture/record").toString() == "1") {
+    path = settings.value("capture/file").toString();
+    if (path.isEmpty()) {
+      path = QStandardPaths::writableLocation(
+                 QStandardPaths::AppDataLocation) +
+             QDateTime::currentDateTime().toString(
+                 "'/capture-'yyyyMMdd-hhmmss'.lkc'");
+    }
+  }
+  if (path.isEmpty()) return Q_NULLPTR;
+
+  qint64 maxBytes =
+      settings.value("capture/max_megabytes", CAPTURE_MAX_MEGABYTES)
+          .toLongLong() *
+      1024 * 1024;
+
+  TrafficCapture *capture = new TrafficCapture(path, nodeName, maxBytes);
+  if (!capture->isOpen()) {
+    delete capture;
+    return Q_NULLPTR;
+  }
+  return capture;
+}
+
+bool TrafficCapture::load(const QString &path, QString *nodeName,
+                          QList<TrafficRecord> *records) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) return false;
+
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_5_5);
+
+  char magic[5];
+  quint32 version;
+  QDateTime started;
+  if (stream.readRawData(magic, 5) != 5 ||
+      qstrncmp(magic, CAPTURE_MAGIC, 5) != 0) {
+    return false;
+  }
+  stream >> version >> *nodeName >> started;
+  if (version != CAPTURE_VERSION) return false;
+
+  // A capture cut short by a crash ends with a partial record
+  while (!stream.atEnd()) {
+    TrafficRecord record;
+    stream >> record;
+    if (stream.status() != QDataStream::Ok) break;
+    *records << record;
+  }
+
+  qDebug() << "CAPTURE: loaded " << records->size() << " exchanges of "
+           << *nodeName << " recorded at " << started.toString(Qt::ISODate);
+  return true;
+}
+
+bool TrafficCapture::isOpen() const { return file.isOpen(); }
+
+void TrafficCapture::record(QNetworkReply *reply, const QString &action,
+                            qint64 sentMsecs, qint64 durationMsecs) {
+  if (!file.isOpen()) return;
+
+  TrafficRecord record;
+  record.sent = sentMsecs;
+  record.duration = durationMsecs;
+  record.operation = reply->operation();
+  record.action = action;
+  record.url = redactUrl(reply->url());
+  record.status =
+      reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+  record.error = reply->error();
+
+  QVariant bytesSent = reply->property("bytesSent");
+  record.bytes = bytesSent.isValid() ? bytesSent.toLongLong()
+                                     : reply->url().toEncoded().size();
+
+  // Peeking leaves the body to the reply's handler
+  record.body =
+      qCompress(redactBody(reply->peek(reply->bytesAvailable())));
+
+  stream << record;
+  file.flush();
+
+  if (file.size() > maxBytes) {
+    qDebug() << "CAPTURE: " << file.fileName()
+             << " is full, stopped recording";
+    file.close();
+  }
+}
+
+QString TrafficCapture::pseudonym(const QString &value) const {
+  if (value.isEmpty()) return value;
+
+  QByteArray hash = QCryptographicHash::hash(salt + value.toUtf8(),
+                                             QCryptographicHash::Sha1);
+  return "patron-" + QString::fromLatin1(hash.toHex().left(8));
+}
+
+QString TrafficCapture::redactUrl(const QUrl &url) const {
+  QUrlQuery query(url);
+  QUrlQuery redacted;
+  typedef QPair<QString, QString> Item;
+  foreach (const Item &item, query.queryItems(QUrl::FullyDecoded)) {
+    if (item.first == "password" || item.first == "session_token") continue;
+
+    if (item.first == "username" || item.first == "reserved_for") {
+      redacted.addQueryItem(item.first, pseudonym(item.second));
+    } else {
+      redacted.addQueryItem(item.first, item.second);
+    }
+  }
+
+  QUrl result(url);
+  result.setUserInfo(QString());
+  result.setQuery(redacted);
+  return result.toString();
+}
+
+QJsonValue TrafficCapture::redactJson(const QJsonValue &value) const {
+  if (value.isArray()) {
+    QJsonArray array;
+    foreach (const QJsonValue &item, value.toArray()) {
+      array.append(redactJson(item));
+    }
+    return array;
+  }
+
+  if (!value.isObject()) return value;
+
+  QJsonObject object = value.toObject();
+  QJsonObject redacted;
+  for (QJsonObject::const_iterator it = object.constBegin();
+       it != object.constEnd(); ++it) {
+    if (it.key() == "password" || it.key() == "session_token") continue;
+
+    if ((it.key() == "username" || it.key() == "reserved_for") &&
+        it.value().isString()) {
+      redacted.insert(it.key(), pseudonym(it.value().toString()));
+    } else {
+      redacted.insert(it.key(), redactJson(it.value()));
+    }
+  }
+  return redacted;
+}
+
+/* Replies are JSON, anything else (e.g. a proxy's error page) is kept */
+QByteArray TrafficCapture::redactBody(const QByteArray &body) const {
+  QJsonDocument document = QJsonDocument::fromJson(body);
+  if (document.isObject()) {
+    document.setObject(redactJson(document.object()).toObject());
+  } else if (document.isArray()) {
+    document.setArray(redactJson(document.array()).toArray());
+  } else {
+    return body;
+  }
+  return document.toJson(QJsonDocument::Compact);
+}
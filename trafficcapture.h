@@ -0,0 +1,87 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRAFFICCAPTURE_H
+#define TRAFFICCAPTURE_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QFile>
+#include <QJsonValue>
+#include <QList>
+#include <QString>
+#include <QtNetwork/QNetworkReply>
+
+/* One request to the server and its reply. Times are milliseconds, the URL
+ * and the body are redacted and the body is compressed. */
+struct TrafficRecord {
+  TrafficRecord()
+      : sent(0), duration(0), operation(0), status(0), error(0), bytes(0) {}
+
+  qint64 sent;
+  qint64 duration;
+  int operation;
+  QString action;
+  QString url;
+  int status;
+  int error;
+  qint64 bytes;
+  QByteArray body;
+};
+
+QDataStream &operator<<(QDataStream &stream, const TrafficRecord &record);
+QDataStream &operator>>(QDataStream &stream, TrafficRecord &record);
+
+/* Records the client's server traffic to a capture file, so a kiosk that
+ * misbehaves in the field can be replayed offline, see TrafficReplay.
+ * Passwords are dropped, usernames are replaced by pseudonyms that are
+ * stable within one capture only, print jobs are recorded by size. Enabled
+ * with capture/record or the LIBKI_CAPTURE environment variable. */
+class TrafficCapture {
+ public:
+  TrafficCapture(const QString &path, const QString &nodeName,
+                 qint64 maxBytes);
+
+  // The capture the settings ask for, null when recording is off
+  static TrafficCapture *fromSettings(const QString &nodeName);
+
+  // Reads a whole capture, false when the file isn't one
+  static bool load(const QString &path, QString *nodeName,
+                   QList<TrafficRecord> *records);
+
+  bool isOpen() const;
+
+  // Must be called before the reply has been read
+  void record(QNetworkReply *reply, const QString &action, qint64 sentMsecs,
+              qint64 durationMsecs);
+
+ private:
+  QFile file;
+  QDataStream stream;
+  qint64 maxBytes;
+
+  // Salts the pseudonyms, so they can't be matched against a list of
+  // patrons
+  QByteArray salt;
+
+  QString pseudonym(const QString &value) const;
+  QString redactUrl(const QUrl &url) const;
+  QJsonValue redactJson(const QJsonValue &value) const;
+  QByteArray redactBody(const QByteArray &body) const;
+};
+
+#endif  // TRAFFICCAPTURE_H
@@ -0,0 +1,221 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trafficreplay.h"
+
+#include <string.h>
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QTimer>
+#include <QUrl>
+#include <QUrlQuery>
+
+#include "networkclient.h"
+#include "perfutils.h"
+#include "scheduler.h"
+
+// Milliseconds the last replies are given to arrive before quitting
+#define REPLAY_GRACE 5000
+
+ReplayedNetworkReply::ReplayedNetworkReply(
+    const QNetworkRequest &request, QNetworkAccessManager::Operation operation,
+    const TrafficRecord &record, int delayMsecs, QObject *parent)
+    : QNetworkReply(parent), offset(0) {
+  setRequest(request);
+  setUrl(request.url());
+  setOperation(operation);
+  open(QIODevice::ReadOnly);
+
+  content = qUncompress(record.body);
+  if (record.status) {
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, record.status);
+  }
+  if (record.error != QNetworkReply::NoError) {
+    setError(QNetworkReply::NetworkError(record.error),
+             QString("Recorded error %1").arg(record.error));
+  }
+
+  QTimer::singleShot(delayMsecs, this, SLOT(deliver()));
+}
+
+void ReplayedNetworkReply::deliver() {
+  if (isFinished()) return;
+
+  emit metaDataChanged();
+  if (error() != QNetworkReply::NoError) emit error(error());
+
+  setFinished(true);
+  if (!content.isEmpty()) {
+    emit downloadProgress(content.size(), content.size());
+    emit readyRead();
+  }
+  emit finished();
+}
+
+void ReplayedNetworkReply::abort() {
+  if (isFinished()) return;
+
+  setError(QNetworkReply::OperationCanceledError, "Operation canceled");
+  emit error(error());
+  setFinished(true);
+  emit finished();
+}
+
+qint64 ReplayedNetworkReply::bytesAvailable() const {
+  qint64 pending = isFinished() ? content.size() - offset : 0;
+  return QNetworkReply::bytesAvailable() + pending;
+}
+
+bool ReplayedNetworkReply::isSequential() const { return true; }
+
+qint64 ReplayedNetworkReply::readData(char *data, qint64 maxSize) {
+  if (!isFinished()) return 0;
+
+  qint64 count = qMin(maxSize, qint64(content.size()) - offset);
+  if (count <= 0) return -1;
+
+  memcpy(data, content.constData() + offset, size_t(count));
+  offset += count;
+  return count;
+}
+
+TrafficReplay::TrafficReplay(NetworkClient *client, double speed)
+    : QNetworkAccessManager(client), client(client), speed(speed) {
+  next = 0;
+  unmatched = 0;
+}
+
+bool TrafficReplay::load(const QString &path) {
+  qDebug("ENTER TrafficReplay::load");
+
+  QString nodeName;
+  if (!TrafficCapture::load(path, &nodeName, &records)) {
+    qDebug() << "REPLAY: " << path << " is not a capture";
+    qDebug("LEAVE TrafficReplay::load");
+    return false;
+  }
+
+  for (int i = 0; i < records.size(); i++) {
+    replies[records.at(i).action] << i;
+  }
+
+  qDebug("LEAVE TrafficReplay::load");
+  return true;
+}
+
+void TrafficReplay::start() {
+  qDebug("ENTER TrafficReplay::start");
+
+  Scheduler *scheduler = Scheduler::instance();
+  scheduler->addJob("replayStep", 0, this, "step", true);
+  scheduler->addJob("replayFinish", 0, this, "finish");
+
+  clock.start();
+  step();
+
+  qDebug("LEAVE TrafficReplay::start");
+}
+
+/* Makes the requests that are due, then sleeps until the next one */
+void TrafficReplay::step() {
+  while (next < records.size() &&
+         records.at(next).sent / speed <= clock.elapsed()) {
+    drive(next++);
+  }
+
+  Scheduler *scheduler = Scheduler::instance();
+  if (next < records.size()) {
+    qint64 due = qint64(records.at(next).sent / speed) - clock.elapsed();
+    scheduler->startOnce("replayStep", int(qMax(due, qint64(0))));
+  } else {
+    scheduler->startOnce("replayFinish", REPLAY_GRACE);
+  }
+}
+
+/* Makes the client send the recorded request the way it did in the field */
+void TrafficReplay::drive(int index) {
+  const TrafficRecord &record = records.at(index);
+  QUrl url(record.url);
+  QUrlQuery query(url);
+
+  if (record.action == "register_node") {
+    QMetaObject::invokeMethod(client, "registerNode", Qt::DirectConnection);
+  } else if (record.action == "get_user_data") {
+    client->getUserDataUpdate();
+  } else if (record.action == "login") {
+    client->attemptLogin(query.queryItemValue("username"), "replay");
+  } else if (record.action == "logout") {
+    client->attemptLogout();
+  } else if (record.action == "clear_message") {
+    QMetaObject::invokeMethod(client, "clearMessage", Qt::DirectConnection);
+  } else if (record.action == "acknowledge_reservation") {
+    client->acknowledgeReservation(query.queryItemValue("reserved_for"));
+  } else if (record.action == "print") {
+    // After a failed upload the next one is the client's own retry
+    int previous = index - 1;
+    while (previous >= 0 && records.at(previous).action != "print") {
+      previous--;
+    }
+    if (previous < 0 || records.at(previous).error == QNetworkReply::NoError) {
+      client->simulatePrintJob(int(record.bytes));
+    }
+  }
+  // The internet connectivity checks aren't run while replaying
+}
+
+QNetworkReply *TrafficReplay::createRequest(Operation operation,
+                                            const QNetworkRequest &request,
+                                            QIODevice *outgoingData) {
+  Q_UNUSED(outgoingData);
+
+  QString action = QUrlQuery(request.url()).queryItemValue("action");
+  if (action.isEmpty()) action = request.url().path().section('/', -1);
+
+  QList<int> &pending = replies[action];
+  if (pending.isEmpty()) {
+    // An empty reply keeps the client from retrying forever
+    unmatched++;
+    qDebug() << "REPLAY: no recorded reply left for " << action;
+
+    TrafficRecord empty;
+    empty.status = 200;
+    empty.body = qCompress(QByteArray("{}"));
+    return new ReplayedNetworkReply(request, operation, empty, 0, this);
+  }
+
+  const TrafficRecord &record = records.at(pending.takeFirst());
+  return new ReplayedNetworkReply(request, operation, record,
+                                  int(record.duration / speed), this);
+}
+
+void TrafficReplay::finish() {
+  qDebug("ENTER TrafficReplay::finish");
+
+  qint64 recorded = records.isEmpty() ? 0 : records.last().sent;
+  qDebug() << QString("REPLAY: %1 exchanges in %2 ms (recorded over %3 ms), "
+                      "%4 requests without a recorded reply, RSS %5 kB")
+                  .arg(records.size())
+                  .arg(clock.elapsed())
+                  .arg(recorded)
+                  .arg(unmatched)
+                  .arg(PerfUtils::residentSetSize());
+
+  QCoreApplication::quit();
+
+  qDebug("LEAVE TrafficReplay::finish");
+}
@@ -0,0 +1,106 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRAFFICREPLAY_H
+#define TRAFFICREPLAY_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
+
+#include "trafficcapture.h"
+
+class NetworkClient;
+
+/* A reply answered from a capture instead of the server */
+class ReplayedNetworkReply : public QNetworkReply {
+  Q_OBJECT
+
+ public:
+  ReplayedNetworkReply(const QNetworkRequest &request,
+                       QNetworkAccessManager::Operation operation,
+                       const TrafficRecord &record, int delayMsecs,
+                       QObject *parent = 0);
+
+  void abort();
+  qint64 bytesAvailable() const;
+  bool isSequential() const;
+
+ protected:
+  qint64 readData(char *data, qint64 maxSize);
+
+ private slots:
+
+  void deliver();
+
+ private:
+  QByteArray content;
+  qint64 offset;
+};
+
+/* Plays a capture recorded by TrafficCapture back into the client: the
+ * requests are made again at their recorded times, divided by the speed, and
+ * each is answered with the next recorded reply for its action after the
+ * recorded latency. The client runs as a simulated node, so the replay
+ * doesn't run commands or change settings, while the windows see the same
+ * logins, messages and reservations the kiosk saw. Requests the capture has
+ * no reply left for, e.g. the windows acknowledging a reservation on their
+ * own, get an empty reply and are counted. The application quits once the
+ * capture has been played. Only built into devtools builds. */
+class TrafficReplay : public QNetworkAccessManager {
+  Q_OBJECT
+
+ public:
+  TrafficReplay(NetworkClient *client, double speed);
+
+  // False when the file isn't a capture
+  bool load(const QString &path);
+
+  void start();
+
+ protected:
+  QNetworkReply *createRequest(Operation operation,
+                               const QNetworkRequest &request,
+                               QIODevice *outgoingData = 0);
+
+ private slots:
+
+  void step();
+  void finish();
+
+ private:
+  NetworkClient *client;
+  double speed;
+
+  QList<TrafficRecord> records;
+  int next;
+
+  // Indexes of the recorded replies not handed out yet, per action
+  QHash<QString, QList<int> > replies;
+  int unmatched;
+
+  QElapsedTimer clock;
+
+  void drive(int index);
+};
+
+#endif  // TRAFFICREPLAY_H
@@ -20,10 +20,16 @@
 #include "utils.h"
 
 #include <QDebug>
+#include <QDir>
+#include <QFile>
 #include <QLocale>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
 #include <QtNetwork/QHostInfo>
 #include <QNetworkInterface>
 #include <QSettings>
+#include <QStandardPaths>
 
 QString getLabel(QString labelcode) {
   qDebug("ENTER utils/getLabel");
@@ -55,10 +61,25 @@ QString getLabel(QString labelcode) {
   return label;
 }
 
+bool passwordsRequired() {
+  QSettings settings;
+  settings.setIniCodec("UTF-8");
+
+  return !settings.value("node/no_passwords").toString().toInt() &&
+         !settings.value("session/EnableClientPasswordlessMode")
+              .toString()
+              .toInt();
+}
+
+// The cached values are used by the windows and the network thread
+static QMutex cacheMutex;
+
 QString clientName = "";
 QString getClientName() {
     qDebug("ENTER utils/getClientName");
 
+    QMutexLocker locker(&cacheMutex);
+
     if ( clientName.length() == 0 ) {
         QSettings settings;
         settings.setIniCodec("UTF-8");
@@ -81,10 +102,9 @@ QString getClientName() {
           clientName = os_username;
         }
 
-        // Fail over to hostname if node name isn't defined.
+        // Fail over to hostname if node name isn't defined. The local
+        // host name needs no lookup, resolving it could block on DNS.
         if (clientName.isEmpty()) {
-          QHostInfo hostInfo;
-          hostInfo = QHostInfo::fromName(QHostInfo::localHostName());
           clientName = QHostInfo::localHostName();
         }
         qDebug() << "NODE NAME: " << clientName;
@@ -96,20 +116,32 @@ QString getClientName() {
 
 QNetworkInterface getNetworkInterface() {
 
+  QNetworkInterface running;
   foreach(QNetworkInterface netInterface, QNetworkInterface::allInterfaces()) {
 
      // Get the first non-loopback MAC Address which is up & running
     if (!(netInterface.flags() & QNetworkInterface::IsLoopBack)
             && netInterface.flags() & QNetworkInterface::IsRunning) {
-        return netInterface;
+        // Prefer one with an IPv4 address, e.g. over a docker bridge
+        foreach (QNetworkAddressEntry addressEntry,
+                 netInterface.addressEntries()) {
+          if (addressEntry.ip().protocol() == QAbstractSocket::IPv4Protocol) {
+            return netInterface;
+          }
+        }
+        if (!running.isValid()) running = netInterface;
     }
   }
+
+  // Invalid when no interface is up, its addresses are empty
+  return running;
 }
 
 QString IPv4Address = "";
 QString getIPv4Address() {
   qDebug("ENTER utils/getIPv4Address");
 
+  QMutexLocker locker(&cacheMutex);
   if ( IPv4Address.length() == 0 ) {
       QNetworkInterface netInterface = getNetworkInterface();
       foreach(QNetworkAddressEntry addressEntry, netInterface.addressEntries()) {
@@ -129,6 +161,7 @@ QString getMACAddress() {
 
   qDebug("ENTER utils/getMACAddress");
 
+  QMutexLocker locker(&cacheMutex);
   if ( MACAddress.length() == 0 ) {
       QNetworkInterface netInterface = getNetworkInterface();
       MACAddress = netInterface.hardwareAddress();
@@ -145,6 +178,7 @@ QString getHostname() {
 
   qDebug("ENTER utils/getHostname");
 
+  QMutexLocker locker(&cacheMutex);
   if ( hostname.length() == 0 ) {
         hostname = QHostInfo::localHostName();
     }
@@ -154,3 +188,64 @@ QString getHostname() {
   return hostname;
 
 }
+
+void clearNetworkIdentity() {
+  qDebug("ENTER utils/clearNetworkIdentity");
+
+  QMutexLocker locker(&cacheMutex);
+  IPv4Address.clear();
+  MACAddress.clear();
+  hostname.clear();
+
+  qDebug("LEAVE utils/clearNetworkIdentity");
+}
+
+QString getCacheDirectory() {
+  qDebug("ENTER utils/getCacheDirectory");
+
+  QString path =
+      QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+  if (path.isEmpty()) {
+    path = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) +
+           "/cache";
+  }
+  qDebug() << "Cache Directory: " << path;
+
+  qDebug("LEAVE utils/getCacheDirectory");
+  return path;
+}
+
+QString getCachedStyleSheet() {
+  qDebug("ENTER utils/getCachedStyleSheet");
+
+  QString styleSheet;
+  QFile file(getCacheDirectory() + "/ClientStyleSheet.qss");
+  if (file.open(QIODevice::ReadOnly)) {
+    styleSheet = QString::fromUtf8(file.readAll());
+  }
+
+  qDebug("LEAVE utils/getCachedStyleSheet");
+  return styleSheet;
+}
+
+void setCachedStyleSheet(QString styleSheet) {
+  qDebug("ENTER utils/setCachedStyleSheet");
+
+  QDir().mkpath(getCacheDirectory());
+
+  QSaveFile file(getCacheDirectory() + "/ClientStyleSheet.qss");
+  if (file.open(QIODevice::WriteOnly)) {
+    file.write(styleSheet.toUtf8());
+    file.commit();
+  }
+
+  qDebug("LEAVE utils/setCachedStyleSheet");
+}
+
+void clearCachedStyleSheet() {
+  qDebug("ENTER utils/clearCachedStyleSheet");
+
+  QFile::remove(getCacheDirectory() + "/ClientStyleSheet.qss");
+
+  qDebug("LEAVE utils/clearCachedStyleSheet");
+}
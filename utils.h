@@ -24,9 +24,21 @@
 
 QString getLabel(QString labelcode);
 
+// False when patrons log in without a password, see node/no_passwords and
+// the server's EnableClientPasswordlessMode
+bool passwordsRequired();
+
 QString getClientName();
 QString getIPv4Address();
 QString getMACAddress();
 QString getHostname();
+// Forgets the cached network identity, the next calls look it up again
+void clearNetworkIdentity();
+
+QString getCacheDirectory();
+
+QString getCachedStyleSheet();
+void setCachedStyleSheet(QString styleSheet);
+void clearCachedStyleSheet();
 
 #endif  // UTILS_H
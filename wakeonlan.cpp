@@ -0,0 +1,170 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "wakeonlan.h"
+
+#include <QDebug>
+#include <QPair>
+#include <QSettings>
+
+#include "scheduler.h"
+
+// Default packets per second
+#define WOL_RATE 50
+// Default number of times each packet is sent
+#define WOL_REPEAT 1
+
+WakeOnLan::WakeOnLan(QObject *parent) : QObject(parent) {
+  qDebug("ENTER WakeOnLan::WakeOnLan");
+
+  socket = new QUdpSocket(this);
+
+  packetsSent = 0;
+  packetsFailed = 0;
+
+  Scheduler::instance()->addJob("wakeOnLan", 1000 / WOL_RATE, this,
+                                "sendNext", true);
+
+  qDebug("LEAVE WakeOnLan::WakeOnLan");
+}
+
+QByteArray WakeOnLan::magicPacket(const QString &macAddress) {
+  QByteArray hex = macAddress.toLatin1();
+  hex.replace(':', "").replace('-', "");
+
+  QByteArray address = QByteArray::fromHex(hex);
+  if (address.size() != 6) return QByteArray();
+
+  // Six bytes of 0xff followed by the address sixteen times
+  QByteArray packet(6, char(0xff));
+  for (int i = 0; i < 16; i++) {
+    packet.append(address);
+  }
+  return packet;
+}
+
+void WakeOnLan::wake(const QStringList &macAddresses, const QString &host,
+                     quint16 port) {
+  qDebug("ENTER WakeOnLan::wake");
+
+  QSettings settings;
+  settings.setIniCodec("UTF-8");
+  int rate = qMax(1, settings.value("wol/rate", WOL_RATE).toInt());
+  int repeat = qMax(1, settings.value("wol/repeat", WOL_REPEAT).toInt());
+
+  QList<QByteArray> packets;
+  foreach (const QString &macAddress, macAddresses) {
+    QByteArray packet = magicPacket(macAddress.trimmed());
+    if (packet.isEmpty()) {
+      qDebug() << "WOL: invalid MAC address " << macAddress;
+      continue;
+    }
+    packets << packet;
+  }
+
+  QList<QHostAddress> addresses = targets(host);
+
+  // Every machine gets a packet before any is repeated
+  for (int round = 0; round < repeat; round++) {
+    foreach (const QByteArray &packet, packets) {
+      foreach (const QHostAddress &address, addresses) {
+        Datagram datagram;
+        datagram.packet = packet;
+        datagram.address = address;
+        datagram.port = port;
+        queue << datagram;
+      }
+    }
+  }
+
+  qDebug() << "WOL: queued " << queue.size() << " packets for "
+           << packets.size() << " MAC addresses to " << addresses.size()
+           << " targets at " << rate << " packets per second";
+
+  if (!queue.isEmpty() && !Scheduler::instance()->isActive("wakeOnLan")) {
+    packetsSent = 0;
+    packetsFailed = 0;
+    burstTimer.start();
+
+    Scheduler::instance()->setInterval("wakeOnLan", qMax(1, 1000 / rate));
+    Scheduler::instance()->start("wakeOnLan");
+  }
+
+  qDebug("LEAVE WakeOnLan::wake");
+}
+
+/* The host sent by the server, plus the broadcast address of each subnet
+ * listed in wol/subnets, e.g. "10.0.1.0/24,10.0.2.0/24" */
+QList<QHostAddress> WakeOnLan::targets(const QString &host) {
+  QList<QHostAddress> addresses;
+
+  QHostAddress hostAddress(host);
+  if (!hostAddress.isNull()) {
+    addresses << hostAddress;
+  }
+
+  QSettings settings;
+  settings.setIniCodec("UTF-8");
+  // A quoted list is read as a single string, an unquoted one as a list
+  QStringList subnets = settings.value("wol/subnets")
+                            .toStringList()
+                            .join(",")
+                            .split(",", QString::SkipEmptyParts);
+
+  foreach (const QString &subnet, subnets) {
+    QPair<QHostAddress, int> parsed =
+        QHostAddress::parseSubnet(subnet.trimmed());
+    if (parsed.first.protocol() != QAbstractSocket::IPv4Protocol) {
+      qDebug() << "WOL: ignoring subnet " << subnet;
+      continue;
+    }
+
+    quint32 mask = parsed.second ? ~quint32(0) << (32 - parsed.second) : 0;
+    QHostAddress broadcast(parsed.first.toIPv4Address() | ~mask);
+    if (!addresses.contains(broadcast)) {
+      addresses << broadcast;
+    }
+  }
+
+  return addresses;
+}
+
+void WakeOnLan::sendNext() {
+  if (queue.isEmpty()) {
+    Scheduler::instance()->stop("wakeOnLan");
+    return;
+  }
+
+  Datagram datagram = queue.takeFirst();
+  qint64 written =
+      socket->writeDatagram(datagram.packet, datagram.address, datagram.port);
+  if (written == datagram.packet.size()) {
+    packetsSent++;
+  } else {
+    packetsFailed++;
+    qDebug() << "WOL: sending to " << datagram.address.toString()
+             << " failed: " << socket->errorString();
+  }
+
+  if (queue.isEmpty()) {
+    Scheduler::instance()->stop("wakeOnLan");
+    qDebug() << QString("WOL: sent %1 packets, %2 failed, in %3 ms")
+                    .arg(packetsSent)
+                    .arg(packetsFailed)
+                    .arg(burstTimer.elapsed());
+  }
+}
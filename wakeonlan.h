@@ -0,0 +1,67 @@
+/*
+ * This file is part of Libki.
+ *
+ * Libki is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Libki is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Libki. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAKEONLAN_H
+#define WAKEONLAN_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QList>
+#include <QObject>
+#include <QStringList>
+#include <QUdpSocket>
+
+/* Sends Wake-on-LAN magic packets for the server. Packets are built once per
+ * MAC address and queued, then sent from a single socket at a limited rate
+ * to the host given by the server and to the directed broadcast address of
+ * each subnet in wol/subnets, optionally repeated. */
+class WakeOnLan : public QObject {
+  Q_OBJECT
+
+ public:
+  WakeOnLan(QObject *parent = 0);
+
+  void wake(const QStringList &macAddresses, const QString &host,
+            quint16 port);
+
+  // Builds the magic packet for a MAC address like 00:11:22:33:44:55,
+  // returns an empty array when the address can't be parsed
+  static QByteArray magicPacket(const QString &macAddress);
+
+ private slots:
+
+  void sendNext();
+
+ private:
+  struct Datagram {
+    QByteArray packet;
+    QHostAddress address;
+    quint16 port;
+  };
+
+  QUdpSocket *socket;
+  QList<Datagram> queue;
+
+  QElapsedTimer burstTimer;
+  int packetsSent;
+  int packetsFailed;
+
+  QList<QHostAddress> targets(const QString &host);
+};
+
+#endif  // WAKEONLAN_H